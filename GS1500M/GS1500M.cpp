@@ -27,30 +27,40 @@
 
 #include "GS1500M.h"
 
+#include <algorithm>
 #include "gpio_api.h"
 #include "mbed_wait_api.h"
-extern "C" WEAK void resetWifi()
+#include "us_ticker_api.h"
+#include "Kernel.h"
+#include "mbed_critical.h"
+static void pulseReset(PinName pin)
 {
     {
         gpio_t gsPD;
-        gpio_init_in(&gsPD, PTD5);
+        gpio_init_in(&gsPD, pin);
         while(!gpio_read(&gsPD))
         {};
     }
 
     {
         gpio_t gsPD;
-        gpio_init_out(&gsPD, PTD5);
+        gpio_init_out(&gsPD, pin);
         gpio_write(&gsPD, 0);
     }
 
     {
         gpio_t gsPD;
-        gpio_init_in(&gsPD, PTD5);
+        gpio_init_in(&gsPD, pin);
         wait(1);
     }
 }
 
+// Wunderbar wiring, used by instances constructed without reset pin
+extern "C" WEAK void resetWifi()
+{
+    pulseReset(PTD5);
+}
+
 Packet::Packet(uint32_t _len)
   : len(_len), data(new char[_len]), offset(0)
 {
@@ -64,17 +74,209 @@ Packet::~Packet()
 
 const size_t MAX_OUTGOING_PACKET_SIZE = 1400;
 const char HOST_APP_ESC_CHAR = 0x1B;
-static const char BULKDATAIN[] = {HOST_APP_ESC_CHAR, 'Z'};
-static const char DATASENDOK[] = {HOST_APP_ESC_CHAR, 'O'};
+static const char BULKDATAIN[] = {HOST_APP_ESC_CHAR, 'Z', '\0'};
+static const char DATASENDOK[] = {HOST_APP_ESC_CHAR, 'O', '\0'};
+static const char DATASENDFAIL[] = {HOST_APP_ESC_CHAR, 'F', '\0'};
+static const char HTTPDATAIN[] = {HOST_APP_ESC_CHAR, 'H', '\0'};
+struct PowerSettings
+{
+    int rxActive;       // AT+WRXACTIVE, radio kept on between beacons
+    int powerSave;      // AT+WRXPS, 802.11 power save
+    int listenInterval; // AT+WIEEEPSPOLL, beacons between wake-ups
+};
+
+static const PowerSettings POWER_SETTINGS[GS1500M_POWER_PROFILE_COUNT] =
+{
+    {1, 0, 0},  // GS1500M_POWER_LOW_LATENCY
+    {0, 1, 1},  // GS1500M_POWER_BALANCED
+    {0, 1, 10}, // GS1500M_POWER_LOW_POWER
+};
+
+// lowest deadline per GS1500MRttClass, keeps short hiccups of a steady
+// link from being reported as failures
+static const uint32_t RTT_FLOORS[GS1500M_RTT_CLASS_COUNT] =
+{
+    50,   // GS1500M_RTT_STATUS
+    100,  // GS1500M_RTT_SOCKET
+    50,   // GS1500M_RTT_DATA
+    500,  // GS1500M_RTT_DNS
+};
+
+// AT+WA on a known channel/BSSID, the fallback full scan gets the rest
+static const uint32_t PINNED_ASSOCIATE_TIMEOUT = 3000;
+
+// asynchronous messages the module emits in verbose mode
+static const char DISCONNECT[] = "DISCONNECT ";
+static const char DISASSOCIATED[] = "DISASSOCIATED";
+static const char DISASSOCIATION_EVENT[] = "Disassociation Event";
+static const char WARMBOOT[] = "UnExpected Warm Boot";
+// the same in numeric mode, a hex digit on a line of its own
+static const char NUMERIC_DISCONNECT[] = "\n8 ";
+static const char NUMERIC_DISASSOCIATED[] = "\n9\r";
+static const char NUMERIC_DISASSOCIATION_EVENT[] = "\nA\r";
+static const char NUMERIC_WARMBOOT[] = "\nE\r";
 
 GS1500M::GS1500M(PinName tx,
                  PinName rx,
-                 int baud)
-    : parser(tx, rx, 115200),
+                 int baud,
+                 PinName reset,
+                 PinName powerDown)
+    : GS1500M(new UartTransport(tx, rx, 115200), true, reset, powerDown)
+{
+}
+
+GS1500M::GS1500M(Transport& transport,
+                 PinName reset,
+                 PinName powerDown)
+    : GS1500M(&transport, false, reset, powerDown)
+{
+}
+
+GS1500M::GS1500M(Transport* transport,
+                 bool owned,
+                 PinName reset,
+                 PinName powerDown)
+    : ownedTransport(owned ? transport : nullptr),
+      parser(*transport),
       mode(0),
-      disconnectedId(-1)
+      sendingId(-1),
+      linkUp(false),
+      powerProfile(GS1500M_POWER_LOW_LATENCY),
+      measureLatency(false),
+      awaitingFirstByte(false),
+      lastSendUs(0),
+      readyCond(readyMutex),
+      queueHighWater(0),
+      queueDrops(0),
+      scanCacheUsed(0),
+      lastChannel(0),
+      lastBssidValid(false),
+      pinned(false),
+      numeric(MBED_CONF_GS1500M_NUMERIC_RESULTS),
+      lastResult(GS1500M_RESULT_NONE),
+      rxPacket(nullptr),
+      rxId(-1),
+      streamBuffer(nullptr),
+      streamNext(nullptr),
+      streamNextLen(0),
+      resetPin(reset),
+      powerDownPin(powerDown)
+{
+    if(powerDownPin != NC)
+    {
+        gpio_init_out(&powerDownGpio, powerDownPin);
+        gpio_write(&powerDownGpio, 1);
+    }
+    memset(ssid, 0, sizeof(ssid));
+    memset(pass, 0, sizeof(pass));
+    memset(wakeLatency, 0, sizeof(wakeLatency));
+    memset(socketStats, 0, sizeof(socketStats));
+    for(int i = 0; i < GS1500M_SOCKET_COUNT; i++)
+    {
+        socketOpen[i] = false;
+        tlsOpen[i] = false;
+        poolIdle[i] = false;
+        poolPort[i] = 0;
+        poolUsedMs[i] = 0;
+        httpAwaitingStatus[i] = false;
+        httpStatus[i] = 0;
+        coalesceBuffer[i] = nullptr;
+        coalesced[i] = 0;
+        txPriority[i] = TX_PRIORITY_BULK;
+        queued[i] = 0;
+        readySeq[i] = 0;
+    }
+    for(int i = 0; i < GS1500M_RTT_CLASS_COUNT; i++)
+    {
+        rtt[i].setFloor(RTT_FLOORS[i]);
+    }
+    // "ERROR" also covers "ERROR: INVALID INPUT", "ERROR: IP CONFIG FAIL" etc.
+    parser.registerFailure("ERROR");
+    parser.registerFailure("INVALID INPUT");
+    // <ESC>Z / <ESC>H<CID><4 digits length><payload>
+    parser.registerFrame(BULKDATAIN, 5, callback(this, &GS1500M::frameHeader),
+                         callback(this, &GS1500M::frameData), callback(this, &GS1500M::_packet_handler));
+    parser.registerFrame(HTTPDATAIN, 5, callback(this, &GS1500M::frameHeader),
+                         callback(this, &GS1500M::frameData), callback(this, &GS1500M::_http_handler));
+    parser.registerSequence(DISCONNECT, callback(this, &GS1500M::socketDisconnected));
+    parser.registerSequence(DISASSOCIATED, callback(this, &GS1500M::linkLost));
+    parser.registerSequence(DISASSOCIATION_EVENT, callback(this, &GS1500M::linkLost));
+    parser.registerSequence(WARMBOOT, callback(this, &GS1500M::linkLost));
+    parser.registerSequence(NUMERIC_DISCONNECT, callback(this, &GS1500M::numericDisconnected));
+    parser.registerSequence(NUMERIC_DISASSOCIATED, callback(this, &GS1500M::numericLinkLost));
+    parser.registerSequence(NUMERIC_DISASSOCIATION_EVENT, callback(this, &GS1500M::numericLinkLost));
+    parser.registerSequence(NUMERIC_WARMBOOT, callback(this, &GS1500M::numericLinkLost));
+}
+
+GS1500MResult GS1500M::decodeResult(const char* line)
+{
+    // both forms are understood, module may still be in the other mode
+    // until startup() switched it
+    if(std::strcmp(line, "OK") == 0)
+    {
+        return GS1500M_RESULT_OK;
+    }
+    if(std::strncmp(line, "ERROR: INVALID INPUT", 20) == 0 || std::strcmp(line, "INVALID INPUT") == 0)
+    {
+        return GS1500M_RESULT_INVALID_INPUT;
+    }
+    if(std::strncmp(line, "ERROR", 5) == 0)
+    {
+        return GS1500M_RESULT_ERROR;
+    }
+    if(line[0] >= '0' && line[0] <= '6' && line[1] == '\0')
+    {
+        return static_cast<GS1500MResult>(line[0] - '0');
+    }
+    return GS1500M_RESULT_NONE;
+}
+
+GS1500MResult GS1500M::result()
+{
+    char line[24];
+    while(parser.readLine(line, sizeof(line)) >= 0)
+    {
+        GS1500MResult res = decodeResult(line);
+        if(res != GS1500M_RESULT_NONE)
+        {
+            lastResult = res;
+            return res;
+        }
+        // information text preceding the result
+    }
+
+    // failure lines end the read early, "ERROR: INVALID INPUT" is more than "ERROR"
+    lastResult = (parser.failure() >= 0) ? decodeResult(parser.failureLine()) : GS1500M_RESULT_NONE;
+    if(lastResult == GS1500M_RESULT_NONE)
+    {
+        lastResult = GS1500M_RESULT_TIMEOUT;
+    }
+    return lastResult;
+}
+
+bool GS1500M::ok()
 {
-    parser.registerSequence(BULKDATAIN, callback(this, &GS1500M::_packet_handler));
+    return result() == GS1500M_RESULT_OK;
+}
+
+GS1500MResult GS1500M::getLastResult()
+{
+    return lastResult;
+}
+
+void GS1500M::setNumericResults(bool enabled)
+{
+    numeric = enabled;
+}
+
+bool GS1500M::isNumericResults()
+{
+    return numeric;
+}
+
+LineLiteral GS1500M::connectPrefix()
+{
+    return LineLiteral(numeric ? "7 " : "CONNECT ");
 }
 
 bool GS1500M::setMode(int _mode)
@@ -89,29 +291,38 @@ bool GS1500M::setMode(int _mode)
     return ret;
 }
 
-bool GS1500M::startup()
+bool GS1500M::startup(uint32_t timeoutMs)
 {
-    return reset()
-        && parser.send("ATV1\n")
-        && parser.recv("OK")
+    BufferedAT::Transaction transaction(parser, timeoutMs);
+    return reset(timeoutMs)
+        && parser.send("ATV%d\n", numeric ? 0 : 1)
+        && ok()
         && parser.send("ATE0\n")
-        && parser.recv("OK")
+        && ok()
         && parser.send("AT+WM=%d\n", mode)
-        && parser.recv("OK")
+        && ok()
         && parser.send("AT+BDATA=1\n")
-        && parser.recv("OK")
+        && ok()
         && parser.send("AT+WST=300,2000\n")
-        && parser.recv("OK");
+        && ok();
 }
 
-bool GS1500M::reset(void)
+bool GS1500M::reset(uint32_t timeoutMs)
 {
-    resetWifi();
+    BufferedAT::Transaction transaction(parser, timeoutMs);
+    if(resetPin != NC)
+    {
+        pulseReset(resetPin);
+    }
+    else
+    {
+        resetWifi();
+    }
     for (int i = 0; i < 2; i++)
     {
         // if(parser.send("AT+RESET") // AT+RESET _does not work_
         if(parser.send("AT\n")
-           && parser.recv("OK"))
+           && ok())
         {
             return true;
         }
@@ -120,24 +331,71 @@ bool GS1500M::reset(void)
     return false;
 }
 
-bool GS1500M::dhcp(bool enabled)
+bool GS1500M::setPowerDown(bool down, uint32_t timeoutMs)
+{
+    if(powerDownPin == NC)
+    {
+        return false;
+    }
+
+    // no command may be in flight while the module goes away
+    BufferedAT::Transaction transaction(parser, timeoutMs);
+    gpio_write(&powerDownGpio, down ? 0 : 1);
+    if(down)
+    {
+        linkLost();
+    }
+    return true;
+}
+
+bool GS1500M::probe(uint32_t timeoutMs)
+{
+    BufferedAT::Transaction transaction(parser, timeoutMs, TX_PRIORITY_CONTROL, &rtt[GS1500M_RTT_STATUS]);
+    // Module that kept its configuration answers AT without echo (ATE0 from
+    // startup() or from the profile stored by connect()). Echo or no answer
+    // at all means it went through a reset and needs full provisioning.
+    char line[16];
+    int len = 0;
+    if(!parser.send("AT\n"))
+    {
+        return false;
+    }
+    // skip empty lines before the result
+    do
+    {
+        len = parser.readLine(line, sizeof(line));
+    }
+    while(len == 0);
+    return (len > 0)
+        && (std::strstr(line, "AT") == nullptr)
+        && (decodeResult(line) == GS1500M_RESULT_OK);
+}
+
+bool GS1500M::dhcp(bool enabled, uint32_t timeoutMs)
 {
+    BufferedAT::Transaction transaction(parser, timeoutMs);
     return parser.send("AT+NDHCP=%d\n", enabled ? 1 : 0)
-        && parser.recv("OK");
+        && ok();
 }
 
-bool GS1500M::connect(const char* ap, const char* passPhrase, nsapi_security_t security)
+bool GS1500M::connect(const char* ap, const char* passPhrase, nsapi_security_t security,
+                      uint8_t channel, const uint8_t* bssid, uint32_t timeoutMs)
 {
+    BufferedAT::Transaction transaction(parser, timeoutMs);
     bool ret = false;
     if(0 == std::strncmp(ssid, ap, sizeof(ssid))
        && 0 == std::strncmp(pass, passPhrase, sizeof(pass)))
     {
+        if(channel == 0 && !bssid)
+        {
+            // try where this network was found last time first
+            channel = lastChannel;
+            bssid = lastBssidValid ? lastBssid : nullptr;
+        }
         ret = parser.send("ATZ0\n")
-               && parser.recv("OK")
-               && parser.send("AT+WA=%s\n", ssid)
-               && parser.recv("OK")
-               && parser.send("AT+WRXPS=0\n")
-               && parser.recv("OK");
+               && ok()
+               && associate(ssid, channel, bssid)
+               && applyPowerProfile();
     }
     else
     {
@@ -150,15 +408,15 @@ bool GS1500M::connect(const char* ap, const char* passPhrase, nsapi_security_t s
                 break;
             case NSAPI_SECURITY_WEP: // WEP (Open only)
                 securityOk = parser.send("AT+WAUTH=1\n") // 1 = WEP (Open only)
-                             && parser.recv("OK")
+                             && ok()
                              && parser.send("AT+WWEP1=%s\n", passPhrase)
-                             && parser.recv("OK");
+                             && ok();
                 break;
             case NSAPI_SECURITY_WPA:  // intentional fall-through
             case NSAPI_SECURITY_WPA2: // intentional fall-through
             case NSAPI_SECURITY_WPA_WPA2:
                 securityOk = parser.send("AT+WPAPSK=%s,%s\n", ap, passPhrase)
-                             && parser.recv("OK");
+                             && ok();
                 break;
             default:
                 securityOk = false;
@@ -167,18 +425,19 @@ bool GS1500M::connect(const char* ap, const char* passPhrase, nsapi_security_t s
 
         if(securityOk)
         {
-            ret = parser.send("AT+WA=%s\n", ap)
-               && parser.recv("OK")
-               && parser.send("AT+WRXPS=0\n")
-               && parser.recv("OK");
+            ret = associate(ap, channel, bssid)
+               && applyPowerProfile();
         }
 
         if(ret)
         {
+            // learnAssociation() below replaces location of previous network
+            lastChannel = 0;
+            lastBssidValid = false;
             parser.send("AT&W0\n");
-            parser.recv("OK");
+            ok();
             parser.send("AT&Y0\n");
-            parser.recv("OK");
+            ok();
             std::strncpy(ssid, ap, sizeof(ssid));
             std::strncpy(pass, passPhrase, sizeof(pass));
         }
@@ -186,24 +445,131 @@ bool GS1500M::connect(const char* ap, const char* passPhrase, nsapi_security_t s
 
     if(ret)
     {
+        linkUp = true;
+        learnAssociation();
         parser.send("AT+DGPIO=30,1\n");
+        ok();
     }
     return ret;
 }
 
-bool GS1500M::disconnect(void)
+bool GS1500M::associate(const char* ap, uint8_t channel, const uint8_t* bssid)
+{
+    pinned = (channel != 0) || bssid;
+    if(pinned)
+    {
+        // AT+WA=<SSID>[,[<BSSID>][,<Ch>]] skips scanning all channels
+        char bssidText[18] = {0};
+        if(bssid)
+        {
+            snprintf(bssidText, sizeof(bssidText), "%02x:%02x:%02x:%02x:%02x:%02x",
+                     bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5]);
+        }
+
+        // a pinned network answers quickly or not at all, the rest of the
+        // deadline is left to the full scan
+        BufferedAT::Deadline deadline(parser, PINNED_ASSOCIATE_TIMEOUT);
+        bool sent = (channel != 0) ? parser.send("AT+WA=%s,%s,%d\n", ap, bssidText, channel)
+                                   : parser.send("AT+WA=%s,%s\n", ap, bssidText);
+        if(sent && ok())
+        {
+            return true;
+        }
+        // network moved, fall back to full scan
+        pinned = false;
+    }
+
+    return parser.send("AT+WA=%s\n", ap)
+        && ok();
+}
+
+void GS1500M::learnAssociation()
+{
+    int channel = 0;
+    if(parser.send("AT+NSTAT=?\n")
+       && parser.match("BSSID=", MacField(nullptr, 0, lastBssid),
+                       "CHANNEL=", IntField(channel))
+       && ok())
+    {
+        lastBssidValid = true;
+        lastChannel = channel;
+    }
+}
+
+bool GS1500M::wasPinned()
+{
+    return pinned;
+}
+
+bool GS1500M::disconnect(uint32_t timeoutMs)
 {
+    BufferedAT::Transaction transaction(parser, timeoutMs);
     parser.send("AT+DGPIO=30,0\n");
-    return parser.send("ATH\n") && parser.recv("OK");
+    ok();
+    bool ret = parser.send("ATH\n") && ok();
+    if(ret)
+    {
+        linkUp = false;
+        for(int i = 0; i < GS1500M_SOCKET_COUNT; i++)
+        {
+            socketOpen[i] = false;
+        }
+    }
+    return ret;
+}
+
+bool GS1500M::setPowerProfile(GS1500MPowerProfile profile, uint32_t timeoutMs)
+{
+    BufferedAT::Transaction transaction(parser, timeoutMs);
+    if(profile >= GS1500M_POWER_PROFILE_COUNT)
+    {
+        return false;
+    }
+
+    powerProfile = profile;
+    // when not associated the profile is applied by next connect()
+    return !linkUp || applyPowerProfile();
+}
+
+GS1500MPowerProfile GS1500M::getPowerProfile()
+{
+    return powerProfile;
+}
+
+bool GS1500M::applyPowerProfile()
+{
+    const PowerSettings& settings = POWER_SETTINGS[powerProfile];
+    bool ret = parser.send("AT+WRXACTIVE=%d\n", settings.rxActive)
+            && ok()
+            && parser.send("AT+WRXPS=%d\n", settings.powerSave)
+            && ok();
+
+    if(ret && settings.powerSave)
+    {
+        ret = parser.send("AT+WIEEEPSPOLL=1,%d\n", settings.listenInterval)
+           && ok();
+    }
+
+    return ret;
+}
+
+void GS1500M::setLatencyMeasurement(bool enabled)
+{
+    awaitingFirstByte = false;
+    measureLatency = enabled;
 }
 
-const char* GS1500M::getIPAddress(void)
+const GS1500MWakeLatency& GS1500M::getWakeLatency(GS1500MPowerProfile profile)
 {
-    //@TODO: parse output
+    return wakeLatency[profile < GS1500M_POWER_PROFILE_COUNT ? profile : GS1500M_POWER_LOW_LATENCY];
+}
+
+const char* GS1500M::getIPAddress(uint32_t timeoutMs)
+{
+    BufferedAT::Transaction transaction(parser, timeoutMs, TX_PRIORITY_BACKGROUND, &rtt[GS1500M_RTT_STATUS]);
     if(!(parser.send("AT+NSTAT=?\n")
-       && parser.recv("IP addr=")
-       && parser.readTill(ipBuffer, sizeof(ipBuffer)-1, "\r")
-       && parser.recv("OK")))
+       && parser.match("IP addr=", Ipv4Field(ipBuffer, sizeof(ipBuffer)))
+       && ok()))
     {
         return 0;
     }
@@ -211,12 +577,12 @@ const char* GS1500M::getIPAddress(void)
     return ipBuffer;
 }
 
-const char* GS1500M::getMACAddress(void)
+const char* GS1500M::getMACAddress(uint32_t timeoutMs)
 {
+    BufferedAT::Transaction transaction(parser, timeoutMs, TX_PRIORITY_BACKGROUND, &rtt[GS1500M_RTT_STATUS]);
     if(!(parser.send("AT+NSTAT=?\n")
-        && parser.recv("MAC=")
-        && parser.readTill(macBuffer, sizeof(macBuffer)-1, "\r")
-        && parser.recv("OK")))
+        && parser.match("MAC=", MacField(macBuffer, sizeof(macBuffer)))
+        && ok()))
     {
         return 0;
     }
@@ -224,12 +590,12 @@ const char* GS1500M::getMACAddress(void)
     return macBuffer;
 }
 
-const char* GS1500M::getGateway()
+const char* GS1500M::getGateway(uint32_t timeoutMs)
 {
+    BufferedAT::Transaction transaction(parser, timeoutMs, TX_PRIORITY_BACKGROUND, &rtt[GS1500M_RTT_STATUS]);
     if(!(parser.send("AT+NSTAT=?\n")
-        && parser.recv("Gateway=")
-        && parser.readTill(gatewayBuffer, sizeof(gatewayBuffer)-1, "\r")
-        && parser.recv("OK")))
+        && parser.match("Gateway=", Ipv4Field(gatewayBuffer, sizeof(gatewayBuffer)))
+        && ok()))
     {
         return 0;
     }
@@ -237,12 +603,12 @@ const char* GS1500M::getGateway()
     return gatewayBuffer;
 }
 
-const char* GS1500M::getNetmask()
+const char* GS1500M::getNetmask(uint32_t timeoutMs)
 {
+    BufferedAT::Transaction transaction(parser, timeoutMs, TX_PRIORITY_BACKGROUND, &rtt[GS1500M_RTT_STATUS]);
     if(!(parser.send("AT+NSTAT=?\n")
-        && parser.recv("SubNet=")
-        && parser.readTill(netmaskBuffer, sizeof(netmaskBuffer)-1, "\r")
-        && parser.recv("OK")))
+        && parser.match("SubNet=", Ipv4Field(netmaskBuffer, sizeof(netmaskBuffer)))
+        && ok()))
     {
         return 0;
     }
@@ -250,245 +616,1192 @@ const char* GS1500M::getNetmask()
     return netmaskBuffer;
 }
 
-int GS1500M::dnslookup(const char* name, char* address)
+int GS1500M::dnslookup(const char* name, char* address, uint32_t timeoutMs)
 {
+    BufferedAT::Transaction transaction(parser, timeoutMs, TX_PRIORITY_CONTROL, &rtt[GS1500M_RTT_DNS]);
     return parser.send("AT+DNSLOOKUP=%s\n", name)
-          && parser.recv("IP:")
-          && parser.readTill(address, 15, "\r")
-          && parser.recv("OK");
+          && parser.match("IP:", Ipv4Field(address, 16))
+          && ok();
 }
 
-int8_t GS1500M::getRSSI()
+int8_t GS1500M::getRSSI(uint32_t timeoutMs)
 {
-    char rssiBuffer[5];
-    int8_t rssi = 0;
+    BufferedAT::Transaction transaction(parser, timeoutMs, TX_PRIORITY_BACKGROUND, &rtt[GS1500M_RTT_STATUS]);
+    int rssi = 0;
 
     if(!(parser.send("AT+NSTAT=?\n")
-        && parser.recv("RSSI=")
-        && parser.readTill(rssiBuffer, sizeof(rssiBuffer)-1, "\r")
-        && parser.recv("OK")))
+        && parser.match("RSSI=", IntField(rssi))
+        && ok()))
     {
         return 0;
     }
 
-    sscanf(rssiBuffer, "%d", reinterpret_cast<int*>(&rssi));
     return rssi;
 }
 
-bool GS1500M::isConnected(void)
+bool GS1500M::isConnected(uint32_t timeoutMs)
 {
-    return getIPAddress() != 0;
+    return getIPAddress(timeoutMs) != 0;
 }
 
-int GS1500M::scan(WiFiAccessPoint *res, unsigned limit)
+int GS1500M::scan(WiFiAccessPoint *res, unsigned limit, uint32_t timeoutMs,
+                  Callback<void(const nsapi_wifi_ap_t&)> onAp)
 {
+    BufferedAT::Transaction transaction(parser, timeoutMs, TX_PRIORITY_BACKGROUND);
     unsigned cnt = 0;
     nsapi_wifi_ap_t ap;
+    int status = 0;
 
     if(!parser.send("AT+WS\n"))
     {
         return NSAPI_ERROR_DEVICE_ERROR;
     }
 
-    while(recv_ap(&ap))
+    while((status = recv_ap(&ap)) > 0)
     {
-        if(cnt < limit)
+        cacheAp(ap);
+        if(res && cnt < limit)
         {
             res[cnt] = WiFiAccessPoint(ap);
         }
+        if(onAp)
+        {
+            onAp(ap);
+        }
 
         cnt++;
         if(limit != 0 && cnt >= limit)
         {
+            while((status = recv_ap(nullptr)) > 0)
+            {}
             break;
         }
     }
 
-    return cnt;
-}
+    if(status < 0 || !ok())
+    {
+        return (cnt > 0) ? cnt : NSAPI_ERROR_DEVICE_ERROR;
+    }
 
-bool GS1500M::open(const char* type, int& id, const char* addr, int port)
-{
-    parser.send("AT+NC%s=%s,%d\n", type, addr, port);
-    parser.recv("CONNECT ");
-    char idraw[2]; // CID is 1 hex digit + null/\n
-    parser.readTill(idraw, sizeof(idraw), "\n");
-    sscanf(idraw, "%1x", &id);
-    parser.recv("OK");
-    // Apparently, against GS documentation, SO_KEEPALIVE (param 8)
-    // must be enabled for "default on" TCP_KEEPALIVE to really work!
-    parser.send("AT+SETSOCKOPT=%x,65535,8,1,4\n", id);
-    return parser.recv("OK");
+    return cnt;
 }
 
-bool GS1500M::bind(const char* type, int& id, int port)
+unsigned GS1500M::getScanCache(GS1500MScanEntry* res, unsigned limit)
 {
-    parser.send("AT+NS%s=%d\n", type, port);
-    parser.recv("CONNECT ");
-    char idraw[2]; // CID is 1 hex digit + null/\n
-    parser.readTill(idraw, sizeof(idraw), "\n");
-    sscanf(idraw, "%1x", &id);
-    return parser.recv("OK");
+    scanCacheMutex.lock();
+    unsigned cnt = std::min(limit, scanCacheUsed);
+    memcpy(res, scanCache, cnt * sizeof(GS1500MScanEntry));
+    scanCacheMutex.unlock();
+    return cnt;
 }
 
-size_t GS1500M::send(int id, const void *data, uint32_t amount)
+void GS1500M::cacheAp(const nsapi_wifi_ap_t& ap)
 {
-    size_t amoutToSend = amount;
-    const char* charData = reinterpret_cast<const char*>(data);
+    scanCacheMutex.lock();
+    unsigned slot = 0;
+    for( ; slot < scanCacheUsed; slot++)
+    {
+        if(memcmp(scanCache[slot].ap.bssid, ap.bssid, sizeof(ap.bssid)) == 0)
+        {
+            break;
+        }
+    }
 
-    while(amoutToSend > MAX_OUTGOING_PACKET_SIZE)
+    if(slot == scanCacheUsed)
     {
-        size_t part = sendPart(id, charData, MAX_OUTGOING_PACKET_SIZE);
-        if(part != 0)
+        if(scanCacheUsed < GS1500M_SCAN_CACHE_SIZE)
         {
-            amoutToSend -= MAX_OUTGOING_PACKET_SIZE;
-            charData += MAX_OUTGOING_PACKET_SIZE;
+            scanCacheUsed++;
         }
         else
         {
-            return 0;
+            // cache full, replace entry seen longest ago
+            slot = 0;
+            for(unsigned i = 1; i < scanCacheUsed; i++)
+            {
+                if(scanCache[i].seenMs < scanCache[slot].seenMs)
+                {
+                    slot = i;
+                }
+            }
         }
     }
 
-    if(sendPart(id, charData, amoutToSend) != 0)
+    scanCache[slot].ap = ap;
+    scanCache[slot].seenMs = rtos::Kernel::get_ms_count();
+    scanCacheMutex.unlock();
+}
+
+bool GS1500M::open(const char* type, int& id, const char* addr, int port, uint32_t timeoutMs)
+{
+    BufferedAT::Transaction transaction(parser, timeoutMs, TX_PRIORITY_CONTROL, &rtt[GS1500M_RTT_SOCKET]);
+    // id is only written on success, it may be a socket's current CID
+    int cid = -1;
+    if(!(parser.send("AT+NC%s=%s,%d\n", type, addr, port)
+         && parser.match(connectPrefix(), HexField(cid))
+         && ok())
+       || !acceptId(cid))
     {
-        return amount;
+        return false;
     }
-
-    return 0;
+    socketOpened(cid);
+    id = cid;
+    return true;
 }
 
-size_t GS1500M::sendPart(int id, const char* data, uint32_t amount)
+bool GS1500M::bind(const char* type, int& id, int port, uint32_t timeoutMs)
 {
-    if(parser.send("%c%c%.1x%.4d", HOST_APP_ESC_CHAR, 'Z', id, amount)
-       && parser.write(data, amount))
+    BufferedAT::Transaction transaction(parser, timeoutMs, TX_PRIORITY_CONTROL, &rtt[GS1500M_RTT_SOCKET]);
+    int cid = -1;
+    bool ret = parser.send("AT+NS%s=%d\n", type, port)
+        && parser.match(connectPrefix(), HexField(cid))
+        && ok()
+        && acceptId(cid);
+    if(ret)
     {
-        if(stackCallback)
-        {
-            stackCallback();
-        }
-        if(parser.recv(DATASENDOK))
-        {
-            return amount;
-        }
+        socketOpened(cid);
+        id = cid;
     }
+    return ret;
+}
 
-    return 0;
+bool GS1500M::addCertificate(const char* name, const void* data, uint32_t length, uint32_t timeoutMs)
+{
+    BufferedAT::Transaction transaction(parser, timeoutMs);
+    // binary (DER) format, kept in RAM so flash is not worn by updates;
+    // the command is answered before the module takes the certificate
+    return parser.send("AT+TCERTADD=%s,0,%lu,1\n", name, (unsigned long)length)
+        && ok()
+        && parser.send("%c%c", HOST_APP_ESC_CHAR, 'W')
+        && parser.write(reinterpret_cast<const char*>(data), length)
+        && ok();
 }
 
-void GS1500M::_packet_handler()
+bool GS1500M::removeCertificate(const char* name, uint32_t timeoutMs)
 {
-    int id = -1;
-    int amount1000 = 0;
-    int amount100 = 0;
-    int amount10 = 0;
-    int amount1 = 0;
-    int amount = 0;
-    char idamount[6] = {0}; // <1 hex for CID><4 digits for len>+\0
-    if(parser.readData(idamount, 5) == 0)
+    BufferedAT::Transaction transaction(parser, timeoutMs);
+    return parser.send("AT+TCERTDEL=%s\n", name)
+        && ok();
+}
+
+bool GS1500M::openTls(int id, const char* caName, uint32_t timeoutMs)
+{
+    if(!validId(id) || !socketOpen[id])
     {
-        return;
+        return false;
     }
 
-    sscanf(reinterpret_cast<char*>(idamount), "%1x%1d%1d%1d%1d", &id, &amount1000, &amount100, &amount10, &amount1);
+    // handshake runs on the module, data on this CID is plain text from now on
+    BufferedAT::Transaction transaction(parser, timeoutMs);
+    tlsOpen[id] = parser.send("AT+SSLOPEN=%x,%s\n", id, caName)
+        && ok();
+    return tlsOpen[id];
+}
 
-    amount = 1000 * amount1000 + 100 * amount100 + 10 * amount10 + amount1;
+bool GS1500M::isTls(int id)
+{
+    return validId(id) && tlsOpen[id];
+}
 
-    Packet* incoming = new Packet(amount);
-    size_t readAmount = parser.readData(incoming->data, amount);
+bool GS1500M::httpConfigure(GS1500MHttpParam param, const char* value, uint32_t timeoutMs)
+{
+    BufferedAT::Transaction transaction(parser, timeoutMs);
+    return parser.send("AT+HTTPCONF=%d,%s\n", param, value)
+        && ok();
+}
 
-    if(readAmount == 0 || id == -1)
+bool GS1500M::httpOpen(const char* host, int port, bool tls, int& id, uint32_t timeoutMs)
+{
+    BufferedAT::Transaction transaction(parser, timeoutMs);
+    int cid = -1;
+    // CID on a line of its own
+    if(!(parser.send("AT+HTTPOPEN=%s,%d,%d\n", host, port, tls ? 1 : 0)
+         && parser.match(HexField(cid))
+         && ok())
+       || !acceptId(cid))
     {
-        delete incoming;
-        return;
+        return false;
     }
 
-    socketQueue[id].put(incoming);
-    if(stackCallback)
-    {
-        stackCallback();
-    }
+    socketOpened(cid);
+    id = cid;
+    return true;
 }
 
-bool GS1500M::accept(int id, int& clientId, char* addr)
+int GS1500M::httpRequest(int id, GS1500MHttpMethod method, const char* path,
+                         const void* body, uint32_t length, uint32_t timeoutMs)
 {
-    //@TODO: accept should be blocking
-    int localServSocketId;
-    parser.recv("CONNECT ");
-    char ids[5];
-    parser.readTill(ids, 5, "\n");
-    sscanf(ids, "%x %d", &localServSocketId, &clientId);
-    return (localServSocketId == id);
-}
-
+    if(!validId(id) || !socketOpen[id])
+    {
+        return -1;
+    }
 
-int32_t GS1500M::recv(int id, void *data, uint32_t amount)
-{
-    osEvent evt = socketQueue[id].get(10);
-    if(osEventMessage == evt.status)
+    uint64_t start = rtos::Kernel::get_ms_count();
+    httpFlags.clear(1 << id);
+    httpAwaitingStatus[id] = true;
+    bool sent;
     {
-        Packet *q = reinterpret_cast<Packet*>(evt.value.p);
-        if(q->len <= amount)
+        BufferedAT::Transaction transaction(parser, timeoutMs, txPriority[id]);
+        // module timeout is in seconds, body follows as <ESC>H<CID><data>
+        uint32_t moduleTimeout = (timeoutMs + 999) / 1000;
+        if(body && length)
         {
-            // Return and remove full packet
-            memcpy(data, q->data + q->offset, q->len);
-            uint32_t len = q->len;
-            delete q;
-            return len;
+            sent = parser.send("AT+HTTPSEND=%x,%d,%lu,%s,%lu\n", id, method, (unsigned long)moduleTimeout, path, (unsigned long)length)
+                && parser.send("%c%c%x", HOST_APP_ESC_CHAR, 'H', id)
+                && parser.write(reinterpret_cast<const char*>(body), length)
+                && ok();
         }
         else
         {
-            // return only partial packet and put the event back in queue with high prio
-            // to be again taken from queue on next recv
-            memcpy(data, q->data + q->offset, amount);
-
-            // update length and data pointer
-            q->offset += amount;
-            q->len -= amount;
-            socketQueue[id].put(q, 0, 255);
-            return amount;
+            sent = parser.send("AT+HTTPSEND=%x,%d,%lu,%s\n", id, method, (unsigned long)moduleTimeout, path)
+                && ok();
         }
     }
-    else
+
+    // status line may arrive after the OK, it is parsed by the RX thread
+    uint32_t elapsed = rtos::Kernel::get_ms_count() - start;
+    if(!sent || elapsed >= timeoutMs
+       || (httpFlags.wait_any(1 << id, timeoutMs - elapsed) & osFlagsError))
     {
+        httpAwaitingStatus[id] = false;
         return -1;
     }
+    return httpStatus[id];
 }
 
-bool GS1500M::close(int id)
+bool GS1500M::httpClose(int id, uint32_t timeoutMs)
 {
-    if(parser.send("AT+NCLOSE=%x\n", id)
-       && parser.recv("OK"))
+    if(!validId(id))
+    {
+        return false;
+    }
+
+    httpAwaitingStatus[id] = false;
+    if(!socketOpen[id])
     {
         return true;
     }
-    //@TODO: check socket queue for any remaining data
+
+    BufferedAT::Transaction transaction(parser, timeoutMs);
+    if(parser.send("AT+HTTPCLOSE=%x\n", id)
+       && ok())
+    {
+        socketOpen[id] = false;
+        return true;
+    }
     return false;
 }
 
-void GS1500M::setTimeout(uint32_t _timeoutMs)
+bool GS1500M::setSocketOption(int id, int type, int param, int value, uint32_t timeoutMs)
 {
-    parser.setTimeout(_timeoutMs);
-}
+    if(!validId(id) || !socketOpen[id])
+    {
+        return false;
+    }
 
-bool GS1500M::readable()
-{
-    return parser.readable();
+    BufferedAT::Transaction transaction(parser, timeoutMs);
+    return parser.send("AT+SETSOCKOPT=%x,%d,%d,%d,4\n", id, type, param, value)
+        && ok();
 }
 
-bool GS1500M::writeable()
+void GS1500M::getSocketStats(int id, GS1500MSocketStats& stats)
 {
-    return parser.writeable();
+    stats = socketStats[id];
+    stats.queueDepth = queued[id];
 }
 
-void GS1500M::attach(Callback<void()> func)
+void GS1500M::socketOpened(int id)
 {
-    stackCallback = func;
+    memset(&socketStats[id], 0, sizeof(socketStats[id]));
+    socketOpen[id] = true;
+    // merge state was dropped by close()/release(), outside any transaction;
+    // coalesceMutex must not be taken here under the parser lock
+    txPriority[id] = TX_PRIORITY_BULK;
+    // only acquire() makes a connection poolable
+    poolPort[id] = 0;
+    notifyReady(id);
 }
 
-bool GS1500M::recv_ap(nsapi_wifi_ap_t* ap)
+size_t GS1500M::send(int id, const void *data, uint32_t amount, uint32_t timeoutMs)
 {
-    //@TODO: Parse GS1500M output
-    bool ret = false;
-    return ret;
+    if(!validId(id))
+    {
+        return 0;
+    }
+
+    size_t amoutToSend = amount;
+    const char* charData = reinterpret_cast<const char*>(data);
+
+    // tested under the lock, setCoalescing(false) may free the buffer meanwhile
+    coalesceMutex.lock();
+    if(coalesceBuffer[id])
+    {
+        while(amoutToSend > 0)
+        {
+            if(coalesced[id] == 0 && amoutToSend >= MAX_OUTGOING_PACKET_SIZE)
+            {
+                // full frame is sent straight from caller buffer
+                if(sendPart(id, charData, MAX_OUTGOING_PACKET_SIZE, timeoutMs) == 0)
+                {
+                    amount = 0;
+                    break;
+                }
+                amoutToSend -= MAX_OUTGOING_PACKET_SIZE;
+                charData += MAX_OUTGOING_PACKET_SIZE;
+                continue;
+            }
+
+            size_t part = std::min(amoutToSend, MAX_OUTGOING_PACKET_SIZE - coalesced[id]);
+            memcpy(coalesceBuffer[id] + coalesced[id], charData, part);
+            coalesced[id] += part;
+            amoutToSend -= part;
+            charData += part;
+            if(coalesced[id] == MAX_OUTGOING_PACKET_SIZE && !flushLocked(id, timeoutMs))
+            {
+                amount = 0;
+                break;
+            }
+        }
+        coalesceMutex.unlock();
+        return amount;
+    }
+    coalesceMutex.unlock();
+
+    while(amoutToSend > MAX_OUTGOING_PACKET_SIZE)
+    {
+        size_t part = sendPart(id, charData, MAX_OUTGOING_PACKET_SIZE, timeoutMs);
+        if(part != 0)
+        {
+            amoutToSend -= MAX_OUTGOING_PACKET_SIZE;
+            charData += MAX_OUTGOING_PACKET_SIZE;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+
+    if(sendPart(id, charData, amoutToSend, timeoutMs) != 0)
+    {
+        return amount;
+    }
+
+    return 0;
+}
+
+bool GS1500M::setCoalescing(int id, bool enabled, uint32_t timeoutMs)
+{
+    if(!validId(id))
+    {
+        return false;
+    }
+
+    bool ret = true;
+    coalesceMutex.lock();
+    if(enabled && !coalesceBuffer[id])
+    {
+        coalesceBuffer[id] = new char[MAX_OUTGOING_PACKET_SIZE];
+        coalesced[id] = 0;
+    }
+    else if(!enabled && coalesceBuffer[id])
+    {
+        ret = flushLocked(id, timeoutMs);
+        delete[] coalesceBuffer[id];
+        coalesceBuffer[id] = nullptr;
+        coalesced[id] = 0;
+    }
+    coalesceMutex.unlock();
+    return ret;
+}
+
+bool GS1500M::isCoalescing(int id)
+{
+    if(!validId(id))
+    {
+        return false;
+    }
+    coalesceMutex.lock();
+    bool ret = (coalesceBuffer[id] != nullptr);
+    coalesceMutex.unlock();
+    return ret;
+}
+
+bool GS1500M::hasPending(int id)
+{
+    if(!validId(id))
+    {
+        return false;
+    }
+    coalesceMutex.lock();
+    bool ret = (coalesced[id] != 0);
+    coalesceMutex.unlock();
+    return ret;
+}
+
+bool GS1500M::sendStream(int id, Callback<size_t(char*, size_t)> producer, uint32_t timeoutMs,
+                         uint32_t* sent)
+{
+    uint32_t total = 0;
+    // merged data was written earlier, it goes first
+    bool ret = flush(id, timeoutMs);
+
+    streamMutex.lock();
+    if(ret && !streamBuffer)
+    {
+        // kept for later streams, allocated only once something is streamed
+        streamBuffer = new char[2 * MAX_OUTGOING_PACKET_SIZE];
+    }
+
+    if(ret)
+    {
+        streamProducer = producer;
+        char* current = streamBuffer;
+        size_t len = std::min(producer(current, MAX_OUTGOING_PACKET_SIZE), MAX_OUTGOING_PACKET_SIZE);
+        while(ret && len > 0)
+        {
+            streamNext = (current == streamBuffer) ? streamBuffer + MAX_OUTGOING_PACKET_SIZE : streamBuffer;
+            streamNextLen = 0;
+            ret = (sendPart(id, current, len, timeoutMs, callback(this, &GS1500M::produceNext)) != 0);
+            if(ret)
+            {
+                total += len;
+            }
+            current = streamNext;
+            len = streamNextLen;
+        }
+        streamProducer = nullptr;
+    }
+    streamMutex.unlock();
+
+    if(sent)
+    {
+        *sent = total;
+    }
+    return ret;
+}
+
+void GS1500M::produceNext()
+{
+    streamNextLen = std::min(streamProducer(streamNext, MAX_OUTGOING_PACKET_SIZE), MAX_OUTGOING_PACKET_SIZE);
+}
+
+bool GS1500M::flush(int id, uint32_t timeoutMs)
+{
+    if(!validId(id))
+    {
+        return false;
+    }
+
+    coalesceMutex.lock();
+    bool ret = flushLocked(id, timeoutMs);
+    coalesceMutex.unlock();
+    return ret;
+}
+
+bool GS1500M::flushLocked(int id, uint32_t timeoutMs)
+{
+    if(coalesced[id] == 0)
+    {
+        return true;
+    }
+
+    bool ret = (sendPart(id, coalesceBuffer[id], coalesced[id], timeoutMs) != 0);
+    // on failure data is dropped, same as for a failed direct send
+    coalesced[id] = 0;
+    return ret;
+}
+
+size_t GS1500M::sendPart(int id, const char* data, uint32_t amount, uint32_t timeoutMs,
+                         Callback<void()> whileQueued)
+{
+    size_t ret = 0;
+    if(!socketOpen[id])
+    {
+        return ret;
+    }
+
+    // time spent in whileQueued is no response time
+    BufferedAT::Transaction transaction(parser, timeoutMs, txPriority[id],
+                                        whileQueued ? nullptr : &rtt[GS1500M_RTT_DATA]);
+    sendingId = id;
+    if(parser.send("%c%c%.1x%.4d", HOST_APP_ESC_CHAR, 'Z', id, amount)
+       && parser.write(data, amount))
+    {
+        if(whileQueued)
+        {
+            whileQueued();
+        }
+        // frames up to 1400 B share one estimator, only the answer is timed
+        parser.startResponseWait();
+        if(stackCallback)
+        {
+            stackCallback();
+        }
+        // module rejects a frame it can not send with ESC F right away
+        if(parser.recvAny({DATASENDOK, DATASENDFAIL}) == 0)
+        {
+            ret = amount;
+            socketStats[id].bytesSent += amount;
+            socketStats[id].framesSent++;
+            if(measureLatency)
+            {
+                lastSendUs = us_ticker_read();
+                awaitingFirstByte = true;
+            }
+        }
+    }
+    sendingId = -1;
+    notifyReady(id);
+
+    return ret;
+}
+
+int GS1500M::frameHeader(const char* header)
+{
+    // <1 hex for CID><4 digits for len>
+    int id = hexValue(header[0]);
+    int amount = 0;
+    for(int i = 1; i < 5; i++)
+    {
+        if(header[i] < '0' || header[i] > '9')
+        {
+            return -1;
+        }
+        amount = 10 * amount + (header[i] - '0');
+    }
+
+    if(awaitingFirstByte)
+    {
+        // first data after a send, includes time the radio needed to wake up
+        awaitingFirstByte = false;
+        uint32_t latencyUs = us_ticker_read() - lastSendUs;
+        GS1500MWakeLatency& stats = wakeLatency[powerProfile];
+        if(stats.samples == 0 || latencyUs < stats.minUs)
+        {
+            stats.minUs = latencyUs;
+        }
+        if(latencyUs > stats.maxUs)
+        {
+            stats.maxUs = latencyUs;
+        }
+        stats.totalUs += latencyUs;
+        stats.samples++;
+    }
+
+    // payload of unknown CID is still consumed, just not kept
+    rxId = id;
+    rxPacket = nullptr;
+    if(validId(id) && amount > 0)
+    {
+        // filled by frameData()
+        rxPacket = new Packet(amount);
+        rxPacket->len = 0;
+    }
+    return amount;
+}
+
+void GS1500M::frameData(const char* data, size_t len)
+{
+    if(rxPacket)
+    {
+        memcpy(rxPacket->data + rxPacket->len, data, len);
+        rxPacket->len += len;
+    }
+}
+
+void GS1500M::queuePacket(int id, Packet* packet)
+{
+    uint32_t len = packet->len;
+    if(socketQueue[id].put(packet) != osOK)
+    {
+        // receiver does not keep up, socket-queue-depth too small
+        delete packet;
+        queueDrops++;
+        socketStats[id].drops++;
+        return;
+    }
+    socketStats[id].bytesReceived += len;
+    socketStats[id].framesReceived++;
+
+    // RX thread counts up, readers count down
+    uint32_t depth = core_util_atomic_incr_u32(&queued[id], 1);
+    if(depth > queueHighWater)
+    {
+        queueHighWater = depth;
+    }
+    notifyReady(id);
+
+    if(stackCallback)
+    {
+        stackCallback();
+    }
+}
+
+void GS1500M::_packet_handler()
+{
+    if(rxPacket)
+    {
+        queuePacket(rxId, rxPacket);
+        rxPacket = nullptr;
+    }
+}
+
+void GS1500M::_http_handler()
+{
+    Packet* incoming = rxPacket;
+    int id = rxId;
+    rxPacket = nullptr;
+    if(!incoming)
+    {
+        return;
+    }
+
+    if(httpAwaitingStatus[id])
+    {
+        // response starts with "<status code> <reason>\r\n"
+        int status = 0;
+        uint32_t i = 0;
+        while(i < incoming->len && isdigit(incoming->data[i]))
+        {
+            status = 10 * status + (incoming->data[i++] - '0');
+        }
+        // rest of the status line up to and including its newline
+        while(i < incoming->len && incoming->data[i] != '\n')
+        {
+            i++;
+        }
+        if(i < incoming->len)
+        {
+            i++;
+        }
+
+        incoming->offset = i;
+        incoming->len -= i;
+        httpStatus[id] = status;
+        httpAwaitingStatus[id] = false;
+        httpFlags.set(1 << id);
+    }
+
+    if(incoming->len == 0)
+    {
+        delete incoming;
+        return;
+    }
+    queuePacket(id, incoming);
+}
+
+bool GS1500M::accept(int id, int& clientId, char* addr, uint32_t timeoutMs)
+{
+    BufferedAT::Transaction transaction(parser, timeoutMs);
+    //@TODO: accept should be blocking
+    // CONNECT <server CID> <new CID> <client IP> <client port>
+    int localServSocketId = -1;
+    int cid = -1;
+    if(!parser.match(connectPrefix(), HexField(localServSocketId), HexField(cid), Ipv4Field(addr, 16))
+       || localServSocketId != id || !acceptId(cid))
+    {
+        return false;
+    }
+
+    socketOpened(cid);
+    clientId = cid;
+    return true;
+}
+
+
+int32_t GS1500M::recv(int id, void *data, uint32_t amount, uint32_t waitMs)
+{
+    if(!validId(id))
+    {
+        // nothing will ever arrive
+        return 0;
+    }
+
+    osEvent evt = socketQueue[id].get(waitMs);
+    if(osEventMessage == evt.status)
+    {
+        Packet *q = reinterpret_cast<Packet*>(evt.value.p);
+        if(q->len <= amount)
+        {
+            // Return and remove full packet
+            memcpy(data, q->data + q->offset, q->len);
+            uint32_t len = q->len;
+            delete q;
+            core_util_atomic_decr_u32(&queued[id], 1);
+            return len;
+        }
+        else
+        {
+            // return only partial packet and put the event back in queue with high prio
+            // to be again taken from queue on next recv
+            memcpy(data, q->data + q->offset, amount);
+
+            // update length and data pointer
+            q->offset += amount;
+            q->len -= amount;
+            socketQueue[id].put(q, 0, 255);
+            return amount;
+        }
+    }
+    else if(!socketOpen[id])
+    {
+        // everything queued was delivered and peer is gone
+        return 0;
+    }
+    else
+    {
+        return -1;
+    }
+}
+
+bool GS1500M::close(int id, uint32_t timeoutMs)
+{
+    if(!validId(id))
+    {
+        return false;
+    }
+
+    // coalescing lock must not be taken inside parser transaction
+    setCoalescing(id, false, timeoutMs);
+    if(!socketOpen[id])
+    {
+        // already closed by peer or by loss of association
+        tlsOpen[id] = false;
+        return true;
+    }
+
+    BufferedAT::Transaction transaction(parser, timeoutMs, TX_PRIORITY_CONTROL, &rtt[GS1500M_RTT_SOCKET]);
+    if(tlsOpen[id])
+    {
+        // close notify to peer, CID itself stays open
+        parser.send("AT+SSLCLOSE=%x\n", id);
+        ok();
+        tlsOpen[id] = false;
+    }
+
+    if(parser.send("AT+NCLOSE=%x\n", id)
+       && ok())
+    {
+        socketOpen[id] = false;
+        txPriority[id] = TX_PRIORITY_BULK;
+        return true;
+    }
+    //@TODO: check socket queue for any remaining data
+    return false;
+}
+
+bool GS1500M::acquire(const char* addr, int port, int& id, bool& reused, uint32_t timeoutMs)
+{
+    if(strlen(addr) >= sizeof(poolAddr[0]))
+    {
+        return false;
+    }
+
+    poolMutex.lock();
+    int found = -1;
+    for(int i = 0; i < GS1500M_SOCKET_COUNT; i++)
+    {
+        // most recently used one is least likely to have been dropped by a NAT
+        if(poolIdle[i] && socketOpen[i] && poolPort[i] == port && strcmp(poolAddr[i], addr) == 0
+           && (found < 0 || poolUsedMs[i] > poolUsedMs[found]))
+        {
+            found = i;
+        }
+    }
+    if(found >= 0)
+    {
+        poolIdle[found] = false;
+    }
+    poolMutex.unlock();
+
+    if(found >= 0)
+    {
+        // late data of the previous user is no answer to the next request
+        discardQueued(found);
+        memset(&socketStats[found], 0, sizeof(socketStats[found]));
+        id = found;
+        reused = true;
+        return true;
+    }
+
+    reused = false;
+    bool ret = open("TCP", id, addr, port, timeoutMs);
+    if(!ret && evictIdle(timeoutMs))
+    {
+        // module may have run out of CIDs
+        ret = open("TCP", id, addr, port, timeoutMs);
+    }
+    if(ret)
+    {
+        strcpy(poolAddr[id], addr);
+        poolPort[id] = port;
+    }
+    return ret;
+}
+
+bool GS1500M::release(int id, uint32_t timeoutMs)
+{
+    if(!validId(id))
+    {
+        return false;
+    }
+
+    // also flushes merged data
+    setCoalescing(id, false, timeoutMs);
+    if(!socketOpen[id] || tlsOpen[id] || poolPort[id] == 0 || GS1500M_POOL_IDLE_MAX == 0)
+    {
+        return close(id, timeoutMs);
+    }
+
+    discardQueued(id);
+    txPriority[id] = TX_PRIORITY_BULK;
+    poolMutex.lock();
+    poolUsedMs[id] = rtos::Kernel::get_ms_count();
+    poolIdle[id] = true;
+    int idle = 0;
+    for(int i = 0; i < GS1500M_SOCKET_COUNT; i++)
+    {
+        idle += poolIdle[i];
+    }
+    poolMutex.unlock();
+
+    bool ret = true;
+    while(idle-- > GS1500M_POOL_IDLE_MAX)
+    {
+        ret = evictIdle(timeoutMs) && ret;
+    }
+    return ret;
+}
+
+bool GS1500M::evictIdle(uint32_t timeoutMs)
+{
+    poolMutex.lock();
+    int coldest = -1;
+    for(int i = 0; i < GS1500M_SOCKET_COUNT; i++)
+    {
+        if(poolIdle[i] && (coldest < 0 || poolUsedMs[i] < poolUsedMs[coldest]))
+        {
+            coldest = i;
+        }
+    }
+    if(coldest >= 0)
+    {
+        poolIdle[coldest] = false;
+    }
+    poolMutex.unlock();
+
+    return coldest >= 0 && close(coldest, timeoutMs);
+}
+
+void GS1500M::discardQueued(int id)
+{
+    osEvent evt = socketQueue[id].get(0);
+    while(evt.status == osEventMessage)
+    {
+        delete reinterpret_cast<Packet*>(evt.value.p);
+        core_util_atomic_decr_u32(&queued[id], 1);
+        evt = socketQueue[id].get(0);
+    }
+}
+
+bool GS1500M::readable()
+{
+    return parser.readable();
+}
+
+bool GS1500M::writeable()
+{
+    return parser.writeable();
+}
+
+void GS1500M::setPriority(int id, TxPriority priority)
+{
+    txPriority[id] = priority;
+}
+
+TxPriority GS1500M::getPriority(int id)
+{
+    return txPriority[id];
+}
+
+RttEstimate GS1500M::getRttEstimate(GS1500MRttClass rttClass)
+{
+    return rtt[rttClass].get();
+}
+
+TxQueueStats GS1500M::getQueueStats(TxPriority priority)
+{
+    return parser.getQueueStats(priority);
+}
+
+void GS1500M::getUsage(GS1500MUsage& usage)
+{
+    usage.parser = parser.getUsage();
+    usage.socketCount = GS1500M_SOCKET_COUNT;
+    usage.socketQueueDepth = GS1500M_SOCKET_QUEUE_DEPTH;
+    usage.socketQueueHighWater = queueHighWater;
+    usage.socketQueueDrops = queueDrops;
+}
+
+bool GS1500M::validId(int id)
+{
+    return (id >= 0) && (id < GS1500M_SOCKET_COUNT);
+}
+
+bool GS1500M::acceptId(int id)
+{
+    if(id >= GS1500M_SOCKET_COUNT && id < 16)
+    {
+        // module has more CIDs than configured socket-count, give this one back
+        parser.send("AT+NCLOSE=%x\n", id);
+        ok();
+    }
+    return validId(id);
+}
+
+bool GS1500M::isSocketOpen(int id)
+{
+    return socketOpen[id];
+}
+
+bool GS1500M::hasData(int id)
+{
+    return queued[id] > 0;
+}
+
+void GS1500M::notifyReady(int id)
+{
+    readyMutex.lock();
+    readySeq[id]++;
+    readyCond.notify_all();
+    readyMutex.unlock();
+}
+
+uint32_t GS1500M::readyCount(uint32_t mask)
+{
+    readyMutex.lock();
+    uint32_t count = readySum(mask);
+    readyMutex.unlock();
+    return count;
+}
+
+bool GS1500M::waitReady(uint32_t mask, uint32_t seen, uint32_t timeoutMs)
+{
+    // every poller is woken, each one checks its own CIDs
+    uint64_t deadline = rtos::Kernel::get_ms_count() + timeoutMs;
+    readyMutex.lock();
+    bool moved = readySum(mask) != seen;
+    while(!moved)
+    {
+        uint64_t now = rtos::Kernel::get_ms_count();
+        if(now >= deadline)
+        {
+            break;
+        }
+        readyCond.wait_for(deadline - now);
+        moved = readySum(mask) != seen;
+    }
+    readyMutex.unlock();
+    return moved;
+}
+
+// readyMutex held
+uint32_t GS1500M::readySum(uint32_t mask)
+{
+    uint32_t sum = 0;
+    for(int i = 0; i < GS1500M_SOCKET_COUNT; i++)
+    {
+        if(mask & (1u << i))
+        {
+            sum += readySeq[i];
+        }
+    }
+    return sum;
+}
+
+bool GS1500M::isLinkUp()
+{
+    return linkUp;
+}
+
+void GS1500M::attach(Callback<void()> func)
+{
+    stackCallback = func;
+}
+
+void GS1500M::attachLink(Callback<void(bool)> func)
+{
+    linkCallback = func;
+}
+
+void GS1500M::closeSocket(int id)
+{
+    socketOpen[id] = false;
+    poolIdle[id] = false;
+    notifyReady(id);
+    if(sendingId == id)
+    {
+        // do not let sender wait for DATASENDOK that will never come
+        parser.abortWait();
+    }
+}
+
+void GS1500M::socketDisconnected()
+{
+    // DISCONNECT <CID>\r\n
+    char idraw[2] = {0};
+    int id = -1;
+    if(parser.readData(idraw, 1) == 0
+       || sscanf(idraw, "%1x", &id) != 1
+       || !validId(id))
+    {
+        return;
+    }
+
+    closeSocket(id);
+    if(stackCallback)
+    {
+        stackCallback();
+    }
+}
+
+void GS1500M::numericDisconnected()
+{
+    // a line starting with "8 " is something else in verbose mode
+    if(numeric)
+    {
+        socketDisconnected();
+    }
+}
+
+void GS1500M::numericLinkLost()
+{
+    if(numeric)
+    {
+        linkLost();
+    }
+}
+
+void GS1500M::linkLost()
+{
+    linkUp = false;
+    for(int i = 0; i < GS1500M_SOCKET_COUNT; i++)
+    {
+        closeSocket(i);
+    }
+
+    if(stackCallback)
+    {
+        stackCallback();
+    }
+    if(linkCallback)
+    {
+        linkCallback(false);
+    }
+}
+
+static char* trim(char* str)
+{
+    while(*str == ' ')
+    {
+        str++;
+    }
+
+    char* end = str + std::strlen(str);
+    while(end > str && end[-1] == ' ')
+    {
+        *--end = '\0';
+    }
+    return str;
+}
+
+static nsapi_security_t parseSecurity(const char* security)
+{
+    if(std::strstr(security, "WPA2"))
+    {
+        return NSAPI_SECURITY_WPA2;
+    }
+    else if(std::strstr(security, "WPA"))
+    {
+        return NSAPI_SECURITY_WPA;
+    }
+    else if(std::strstr(security, "WEP"))
+    {
+        return NSAPI_SECURITY_WEP;
+    }
+    else if(std::strstr(security, "NONE"))
+    {
+        return NSAPI_SECURITY_NONE;
+    }
+    return NSAPI_SECURITY_UNKNOWN;
+}
+
+// <BSSID>, <SSID>, <Channel>, <Type>, <RSSI>, <Security>
+static bool parseAp(char* line, nsapi_wifi_ap_t* ap)
+{
+    char* ssid = std::strchr(line, ',');
+    if(!ssid)
+    {
+        return false;
+    }
+    *ssid++ = '\0';
+
+    // SSID may contain commas, so remaining fields are taken from the end
+    char* fields[4];
+    for(int i = 3; i >= 0; i--)
+    {
+        char* comma = std::strrchr(ssid, ',');
+        if(!comma)
+        {
+            return false;
+        }
+        *comma = '\0';
+        fields[i] = trim(comma + 1);
+    }
+
+    unsigned int bssid[6];
+    if(sscanf(trim(line), "%2x:%2x:%2x:%2x:%2x:%2x",
+              &bssid[0], &bssid[1], &bssid[2], &bssid[3], &bssid[4], &bssid[5]) != 6)
+    {
+        return false;
+    }
+
+    for(int i = 0; i < 6; i++)
+    {
+        ap->bssid[i] = bssid[i];
+    }
+    std::strncpy(ap->ssid, trim(ssid), sizeof(ap->ssid) - 1);
+    ap->ssid[sizeof(ap->ssid) - 1] = '\0';
+    ap->channel = atoi(fields[0]);
+    ap->rssi = atoi(fields[2]);
+    ap->security = parseSecurity(fields[3]);
+    return true;
+}
+
+// Reads AT+WS output up to next access point. Returns 1 when ap was filled
+// (or a line was skipped for null ap), 0 at end of list, -1 on error.
+int GS1500M::recv_ap(nsapi_wifi_ap_t* ap)
+{
+    char line[128];
+    while(parser.readLine(line, sizeof(line)) >= 0)
+    {
+        if(std::strncmp(line, "No.Of AP Found", 14) == 0)
+        {
+            return 0;
+        }
+        if(decodeResult(line) > GS1500M_RESULT_OK)
+        {
+            return -1;
+        }
+        if(!ap)
+        {
+            return 1;
+        }
+        if(parseAp(line, ap))
+        {
+            return 1;
+        }
+        // column header or empty line
+    }
+    return -1;
 }
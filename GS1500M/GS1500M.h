@@ -30,8 +30,122 @@
 #include "bufferedat.h"
 #include "WiFiAccessPoint.h"
 #include "Queue.h"
+#include "PlatformMutex.h"
+#include "EventFlags.h"
+#include "Mutex.h"
+#include "ConditionVariable.h"
+#include "gpio_api.h"
 
-constexpr int GS1500M_SOCKET_COUNT = 16;
+constexpr int GS1500M_SOCKET_COUNT = MBED_CONF_GS1500M_SOCKET_COUNT;
+constexpr int GS1500M_SOCKET_QUEUE_DEPTH = MBED_CONF_GS1500M_SOCKET_QUEUE_DEPTH;
+constexpr int GS1500M_SCAN_CACHE_SIZE = MBED_CONF_GS1500M_SCAN_CACHE_SIZE;
+constexpr int GS1500M_POOL_IDLE_MAX = MBED_CONF_GS1500M_POOL_IDLE_MAX;
+static_assert(GS1500M_SOCKET_COUNT > 0 && GS1500M_SOCKET_COUNT <= 16, "GS1500M supports at most 16 CIDs");
+
+// configured sizes and observed peak usage, for sizing mbed_lib.json values
+struct GS1500MUsage
+{
+    BufferedATUsage parser;
+    uint32_t socketCount;
+    uint32_t socketQueueDepth;
+    uint32_t socketQueueHighWater;
+    uint32_t socketQueueDrops;
+    uint32_t workerStackSize;
+    uint32_t workerStackHighWater;
+};
+
+enum GS1500MPowerProfile
+{
+    GS1500M_POWER_LOW_LATENCY, // radio always on, no 802.11 power save
+    GS1500M_POWER_BALANCED,    // power save, wake on every beacon
+    GS1500M_POWER_LOW_POWER,   // power save, long listen interval
+    GS1500M_POWER_PROFILE_COUNT
+};
+
+// request-to-first-response-byte latency observed in measurement mode
+struct GS1500MWakeLatency
+{
+    uint32_t samples;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint64_t totalUs;
+};
+
+// Commands sharing response time estimation. Their timeoutMs is the
+// ceiling, the deadline actually used follows measured response times.
+enum GS1500MRttClass
+{
+    GS1500M_RTT_STATUS,    // AT+NSTAT and probe
+    GS1500M_RTT_SOCKET,    // open, bind, close
+    GS1500M_RTT_DATA,      // bulk frame to DATASENDOK
+    GS1500M_RTT_DNS,
+    // association is not estimated: ATZ0 reconnects, pinned and full-scan
+    // AT+WA differ by seconds and would drive each other's deadline
+    GS1500M_RTT_CLASS_COUNT
+};
+
+// Traffic of one CID since it was opened
+struct GS1500MSocketStats
+{
+    uint32_t bytesSent;
+    uint32_t bytesReceived;
+    uint32_t framesSent;
+    uint32_t framesReceived;
+    uint32_t queueDepth;  // received packets not read yet
+    uint32_t drops;       // received packets lost to a full queue
+    int lastError;        // last nsapi error reported on the socket, filled by the interface
+};
+
+// AT+SETSOCKOPT type (level) and parameter values
+const int GS1500M_SOL_SOCKET = 65535;
+const int GS1500M_IPPROTO_TCP = 6;
+const int GS1500M_SO_KEEPALIVE = 8;
+const int GS1500M_SO_SNDBUF = 0x1001;
+const int GS1500M_SO_RCVBUF = 0x1002;
+const int GS1500M_TCP_NODELAY = 1;
+const int GS1500M_TCP_KEEPALIVE = 0x4001; // idle seconds before first probe
+
+// Final result of a command. In numeric mode (ATV0) the module sends the
+// value as a single digit instead of text.
+enum GS1500MResult
+{
+    GS1500M_RESULT_TIMEOUT = -2,
+    GS1500M_RESULT_NONE = -1,         // line is no result
+    GS1500M_RESULT_OK = 0,
+    GS1500M_RESULT_ERROR = 1,
+    GS1500M_RESULT_INVALID_INPUT = 2,
+    GS1500M_RESULT_SOCKET_FAILURE = 3,
+    GS1500M_RESULT_NO_CID = 4,
+    GS1500M_RESULT_INVALID_CID = 5,
+    GS1500M_RESULT_NOT_SUPPORTED = 6
+};
+
+// AT+HTTPCONF header parameters
+enum GS1500MHttpParam
+{
+    GS1500M_HTTP_AUTHORIZATION = 2,
+    GS1500M_HTTP_CONNECTION = 3,
+    GS1500M_HTTP_CONTENT_TYPE = 7,
+    GS1500M_HTTP_HOST = 11,
+    GS1500M_HTTP_USER_AGENT = 20
+};
+
+// AT+HTTPSEND request types
+enum GS1500MHttpMethod
+{
+    GS1500M_HTTP_GET = 1,
+    GS1500M_HTTP_HEAD = 2,
+    GS1500M_HTTP_POST = 3,
+    GS1500M_HTTP_PUT = 4,
+    GS1500M_HTTP_DELETE = 5
+};
+
+// access point seen by a scan and when (rtos::Kernel::get_ms_count())
+struct GS1500MScanEntry
+{
+    nsapi_wifi_ap_t ap;
+    uint64_t seenMs;
+};
 
 struct Packet
 {
@@ -45,40 +159,143 @@ struct Packet
 class GS1500M
 {
 public:
+    // reset and powerDown are optional per module pins; without reset pin
+    // the weak resetWifi() is used
     GS1500M(PinName tx,
             PinName rx,
-            int baud);
+            int baud,
+            PinName reset = NC,
+            PinName powerDown = NC);
+    // module on another link, e.g. SpiTransport; transport must outlive this
+    explicit GS1500M(Transport& transport,
+                     PinName reset = NC,
+                     PinName powerDown = NC);
+    // deletes transport on destruction when owned
+    GS1500M(Transport* transport, bool owned, PinName reset, PinName powerDown);
 
     void aterror();
 
     bool setMode(int _mode);
-    bool startup();
-    bool reset();
-    bool dhcp(bool enabled);
-    bool connect(const char* ap, const char* passPhrase, nsapi_security_t security);
-    bool disconnect();
-    bool isConnected();
-
-    const char* getIPAddress();
-    const char* getMACAddress();
-    const char* getGateway();
-    const char* getNetmask();
-    int8_t getRSSI();
-
-    int dnslookup(const char *name, char* address);
-
-    int scan(WiFiAccessPoint* res, unsigned limit);
-
-    bool open(const char* type, int& id, const char* addr, int port);
-    bool bind(const char* type, int& id, int port);
-    size_t send(int id, const void* data, uint32_t amount);
-    int32_t recv(int id, void* data, uint32_t amount);
-    bool accept(int id, int& clientId, char* addr);
-    bool close(int id);
-    void setTimeout(uint32_t _timeoutMs);
+    // Numeric result codes (ATV0) save bytes on every reply. Applied by the
+    // next startup(). Asynchronous notifications (DISCONNECT, disassociation,
+    // warm boot) are recognised in both forms.
+    void setNumericResults(bool enabled);
+    bool isNumericResults();
+    // result of the last command that got one
+    GS1500MResult getLastResult();
+    // every operation taking timeoutMs runs as one parser transaction that
+    // has to complete within that time
+    bool startup(uint32_t timeoutMs);
+    bool reset(uint32_t timeoutMs);
+    // Holds the module in power-down (pin low) or releases it. Sockets and
+    // link are gone while down, startup() is needed after release. False
+    // without powerDown pin.
+    bool setPowerDown(bool down, uint32_t timeoutMs);
+    bool probe(uint32_t timeoutMs);
+    bool dhcp(bool enabled, uint32_t timeoutMs);
+    // Non-zero channel and/or bssid are passed to the module to skip full
+    // scan. Without them the channel and BSSID of last successful association
+    // to the same network are tried first. Full scan is the fallback.
+    bool connect(const char* ap, const char* passPhrase, nsapi_security_t security,
+                 uint8_t channel, const uint8_t* bssid, uint32_t timeoutMs);
+    // true when last connect() associated without full scan
+    bool wasPinned();
+    bool disconnect(uint32_t timeoutMs);
+    bool isConnected(uint32_t timeoutMs);
+
+    bool setPowerProfile(GS1500MPowerProfile profile, uint32_t timeoutMs);
+    GS1500MPowerProfile getPowerProfile();
+    void setLatencyMeasurement(bool enabled);
+    const GS1500MWakeLatency& getWakeLatency(GS1500MPowerProfile profile);
+
+    const char* getIPAddress(uint32_t timeoutMs);
+    const char* getMACAddress(uint32_t timeoutMs);
+    const char* getGateway(uint32_t timeoutMs);
+    const char* getNetmask(uint32_t timeoutMs);
+    int8_t getRSSI(uint32_t timeoutMs);
+
+    int dnslookup(const char *name, char* address, uint32_t timeoutMs);
+
+    // res may be null when only onAp is used; after limit access points
+    // the rest of the module output is skipped without being parsed
+    int scan(WiFiAccessPoint* res, unsigned limit, uint32_t timeoutMs,
+             Callback<void(const nsapi_wifi_ap_t&)> onAp = nullptr);
+    unsigned getScanCache(GS1500MScanEntry* res, unsigned limit);
+
+    bool open(const char* type, int& id, const char* addr, int port, uint32_t timeoutMs);
+    bool bind(const char* type, int& id, int port, uint32_t timeoutMs);
+
+    // TLS client of the module. Certificates are referenced by name,
+    // openTls() runs the handshake on an already connected TCP CID.
+    bool addCertificate(const char* name, const void* data, uint32_t length, uint32_t timeoutMs);
+    bool removeCertificate(const char* name, uint32_t timeoutMs);
+    bool openTls(int id, const char* caName, uint32_t timeoutMs);
+    bool isTls(int id);
+
+    // AT+SETSOCKOPT on an open CID, value is always 4 bytes wide
+    bool setSocketOption(int id, int type, int param, int value, uint32_t timeoutMs);
+    void getSocketStats(int id, GS1500MSocketStats& stats);
+
+    // HTTP client of the module. Headers set with httpConfigure() are used
+    // by all following requests. The connection returned by httpOpen() is
+    // a CID, httpRequest() returns the status code (-1 on failure) and the
+    // response body is then read with recv() on the same CID, chunk by chunk.
+    bool httpConfigure(GS1500MHttpParam param, const char* value, uint32_t timeoutMs);
+    bool httpOpen(const char* host, int port, bool tls, int& id, uint32_t timeoutMs);
+    int httpRequest(int id, GS1500MHttpMethod method, const char* path,
+                    const void* body, uint32_t length, uint32_t timeoutMs);
+    bool httpClose(int id, uint32_t timeoutMs);
+
+    // timeoutMs applies to each bulk frame
+    size_t send(int id, const void* data, uint32_t amount, uint32_t timeoutMs);
+    // Sends whatever producer writes into the frame buffer it is given, one
+    // bulk frame per call, until it returns 0. The producer fills the next
+    // frame while the previous one is being transmitted. timeoutMs applies
+    // to each frame. sent (optional) counts bytes delivered, also on failure.
+    // The producer runs with the parser locked and must not issue commands.
+    bool sendStream(int id, Callback<size_t(char*, size_t)> producer, uint32_t timeoutMs,
+                    uint32_t* sent = nullptr);
+    // small sends are merged into full bulk frames until flush()
+    bool setCoalescing(int id, bool enabled, uint32_t timeoutMs);
+    bool isCoalescing(int id);
+    bool hasPending(int id);
+    bool flush(int id, uint32_t timeoutMs);
+    // bulk frames of a socket are queued for the UART in this class
+    void setPriority(int id, TxPriority priority);
+    TxPriority getPriority(int id);
+    TxQueueStats getQueueStats(TxPriority priority);
+    RttEstimate getRttEstimate(GS1500MRttClass rttClass);
+    // fills everything but worker thread fields, which belong to the interface
+    void getUsage(GS1500MUsage& usage);
+    // waits up to waitMs for data, -1 when nothing arrived
+    int32_t recv(int id, void* data, uint32_t amount, uint32_t waitMs = 10);
+    bool accept(int id, int& clientId, char* addr, uint32_t timeoutMs);
+    bool close(int id, uint32_t timeoutMs);
+    // Keep-warm TCP connections keyed by addr:port. acquire() hands out an
+    // idle connection that is still open (reused set) or opens a new one.
+    // release() parks it for the next acquire(); a connection closed by the
+    // peer meanwhile is dropped. At most GS1500M_POOL_IDLE_MAX stay idle,
+    // the least recently used is closed. Module options set on the CID stay
+    // with it, data queued for the previous user and its statistics are
+    // discarded.
+    bool acquire(const char* addr, int port, int& id, bool& reused, uint32_t timeoutMs);
+    bool release(int id, uint32_t timeoutMs);
     bool readable();
     bool writeable();
+    bool isSocketOpen(int id);
+    bool isLinkUp();
+    // Readiness for GS1500MInterface::poll(), an event count per CID, raised
+    // on received data, disconnect, link loss and completed sends. A poller
+    // takes readyCount() of its CIDs before looking at them, waitReady()
+    // returns once that count moved on. Nothing is cleared, so any number
+    // of threads may poll the same CIDs.
+    bool hasData(int id);
+    void notifyReady(int id);
+    uint32_t readyCount(uint32_t mask);
+    bool waitReady(uint32_t mask, uint32_t seen, uint32_t timeoutMs);
     void attach(Callback<void()> func);
+    // called from RX thread when module reports loss (false) of association
+    void attachLink(Callback<void(bool)> func);
     template <typename T, typename M>
     void attach(T* obj, M method)
     {
@@ -87,22 +304,102 @@ public:
 
 private:
     void _packet_handler();
+    static GS1500MResult decodeResult(const char* line);
+    GS1500MResult result();
+    bool ok();
+    LineLiteral connectPrefix();
+    void _http_handler();
+    int frameHeader(const char* header);
+    void frameData(const char* data, size_t len);
+    void socketOpened(int id);
+    void queuePacket(int id, Packet* packet);
     void _oobconnect_handler();
-    bool recv_ap(nsapi_wifi_ap_t* ap);
+    int recv_ap(nsapi_wifi_ap_t* ap);
+    void cacheAp(const nsapi_wifi_ap_t& ap);
     void socketDisconnected();
-    size_t sendPart(int id, const char* data, uint32_t amount);
+    void numericDisconnected();
+    void linkLost();
+    void numericLinkLost();
+    void closeSocket(int id);
+    bool applyPowerProfile();
+    bool associate(const char* ap, uint8_t channel, const uint8_t* bssid);
+    void learnAssociation();
+    bool flushLocked(int id, uint32_t timeoutMs);
+    bool validId(int id);
+    bool acceptId(int id);
+    // whileQueued runs once the frame is queued for the UART, before waiting
+    // for the module to take it
+    size_t sendPart(int id, const char* data, uint32_t amount, uint32_t timeoutMs,
+                    Callback<void()> whileQueued = nullptr);
+    void produceNext();
+    void discardQueued(int id);
+    bool evictIdle(uint32_t timeoutMs);
+    uint32_t readySum(uint32_t mask);
 
 private:
+    // UART transport created by the pin constructor, before parser uses it
+    std::unique_ptr<Transport> ownedTransport;
     BufferedAT parser;
     int mode;
-    int disconnectedId;
+    volatile int sendingId;
+    volatile bool linkUp;
+    volatile bool socketOpen[GS1500M_SOCKET_COUNT];
+    bool tlsOpen[GS1500M_SOCKET_COUNT];
+    volatile bool httpAwaitingStatus[GS1500M_SOCKET_COUNT];
+    volatile int httpStatus[GS1500M_SOCKET_COUNT];
+    rtos::EventFlags httpFlags;
+    RttEstimator rtt[GS1500M_RTT_CLASS_COUNT];
+    GS1500MPowerProfile powerProfile;
+    bool measureLatency;
+    volatile bool awaitingFirstByte;
+    volatile uint32_t lastSendUs;
+    GS1500MWakeLatency wakeLatency[GS1500M_POWER_PROFILE_COUNT];
     // all buffers have +1 size for termination character
     char ipBuffer[16];
     char gatewayBuffer[16];
     char netmaskBuffer[16];
     char macBuffer[18];
     Callback<void()> stackCallback;
-    rtos::Queue<Packet, 5> socketQueue[GS1500M_SOCKET_COUNT];
+    Callback<void(bool)> linkCallback;
+    rtos::Queue<Packet, GS1500M_SOCKET_QUEUE_DEPTH> socketQueue[GS1500M_SOCKET_COUNT];
+    volatile uint32_t queued[GS1500M_SOCKET_COUNT];
+    uint32_t readySeq[GS1500M_SOCKET_COUNT];
+    rtos::Mutex readyMutex;
+    rtos::ConditionVariable readyCond;
+    // connection pool, by CID; poolIdle is also cleared by the RX thread
+    volatile bool poolIdle[GS1500M_SOCKET_COUNT];
+    char poolAddr[GS1500M_SOCKET_COUNT][16];
+    int poolPort[GS1500M_SOCKET_COUNT];
+    uint64_t poolUsedMs[GS1500M_SOCKET_COUNT];
+    PlatformMutex poolMutex;
+    volatile uint32_t queueHighWater;
+    volatile uint32_t queueDrops;
+    GS1500MSocketStats socketStats[GS1500M_SOCKET_COUNT];
+    GS1500MScanEntry scanCache[GS1500M_SCAN_CACHE_SIZE];
+    unsigned scanCacheUsed;
+    PlatformMutex scanCacheMutex;
+    uint8_t lastChannel;
+    uint8_t lastBssid[6];
+    bool lastBssidValid;
+    bool pinned;
+    bool numeric;
+    GS1500MResult lastResult;
+    // frame being received, RX thread only
+    Packet* rxPacket;
+    int rxId;
+    char* coalesceBuffer[GS1500M_SOCKET_COUNT];
+    uint32_t coalesced[GS1500M_SOCKET_COUNT];
+    TxPriority txPriority[GS1500M_SOCKET_COUNT];
+    PlatformMutex coalesceMutex;
+    // two frames, one on the wire while the producer fills the other
+    char* streamBuffer;
+    PlatformMutex streamMutex;
+    Callback<size_t(char*, size_t)> streamProducer;
+    char* streamNext;
+    size_t streamNextLen;
+    PinName resetPin;
+    PinName powerDownPin;
+    gpio_t powerDownGpio;
 
     char ssid[33]; /* 32 is what 802.11 defines as longest possible name; +1 for the \0 */
     char pass[64]; /* The longest allowed passphrase */
@@ -27,6 +27,8 @@ public:
         : bsize(buffSize),
           head(0),
           tail(0),
+          highWater(0),
+          overruns(0),
           buf(std::make_unique<uint8_t []>(bsize))
     {
     }
@@ -39,6 +41,17 @@ public:
         {
             head = 0;
         }
+
+        size_t used = size();
+        if(used > highWater)
+        {
+            highWater = used;
+        }
+        if(head == tail)
+        {
+            // writer caught up with reader, whole buffer content is lost
+            overruns++;
+        }
     }
 
     uint8_t pop()
@@ -57,6 +70,32 @@ public:
         return (tail == head);
     }
 
+    size_t size()
+    {
+        return (head >= tail) ? (head - tail) : (bsize - tail + head);
+    }
+
+    size_t capacity()
+    {
+        return bsize;
+    }
+
+    size_t maxUsed()
+    {
+        return highWater;
+    }
+
+    uint32_t overrunCount()
+    {
+        return overruns;
+    }
+
+    // drops everything not read yet, reader side only
+    void clear()
+    {
+        tail = head;
+    }
+
     void rewind(size_t amount)
     {
         tail -= amount;
@@ -70,5 +109,7 @@ private:
     size_t bsize;
     volatile size_t head;
     volatile size_t tail;
+    volatile size_t highWater;
+    volatile uint32_t overruns;
     ByteBuffer buf;
 };
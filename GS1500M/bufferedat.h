@@ -16,39 +16,170 @@
 
 #pragma once
 
-#include "PinNames.h"
-#include "RawSerial.h"
+#include "transport.h"
 #include "Thread.h"
 #include "Callback.h"
 #include "Timer.h"
-#include "PlatformMutex.h"
+#include "EventFlags.h"
+#include "mbed_critical.h"
+#include "txscheduler.h"
 #include "specialsequence.h"
 #include "buffer.h"
-#include <regex>
+#include "responsegrammar.h"
+#include "rttestimator.h"
 #include <vector>
+#include <algorithm>
+#include <initializer_list>
 #include <cstdarg>
+#include <cstring>
 
-using mbed::RawSerial;
 using mbed::callback;
 using mbed::Callback;
 using mbed::Timer;
 using rtos::Thread;
 
 const int READ_TIMEOUT = 1000;
+const size_t MAX_FAILURE_SEQUENCES = 4;
+const size_t MAX_FAILURE_LINE = 32;
+const size_t MAX_ALTERNATIVES = 4;
+const size_t MAX_FRAME_HEADER = 8;
+const size_t RX_CHUNK_SIZE = 64;
+const uint32_t TX_SPACE_FLAG = 0x1;
+const uint32_t TX_IDLE_FLAG = 0x2;
+
+struct BufferedATUsage
+{
+    size_t rxBufferSize;
+    size_t rxBufferHighWater;
+    uint32_t rxBufferOverruns;
+    size_t responseBufferSize;
+    size_t responseBufferHighWater;
+    uint32_t responseBufferOverruns;
+    size_t txBufferSize;
+    size_t txBufferHighWater;
+    size_t txRingSize;
+    size_t txRingHighWater;
+    uint32_t rxStackSize;
+    uint32_t rxStackHighWater;
+};
 
 class BufferedAT
 {
 public:
-    BufferedAT(PinName tx, PinName rx, size_t baud)
-        : serial(tx, rx, baud),
-          oob(osPriorityHigh, 8192/2),
-          ob(4*1512),
-          rb(512),
-          timeout(1000),
-          pushed(0)
+    // Command, response parsing and deadline as one atomic unit. Other
+    // threads queue by priority class until the transaction is destroyed.
+    // Nested transactions in the same thread keep the outermost deadline.
+    // With an estimator, _timeoutMs is only the ceiling of the deadline and
+    // the time the module took to answer is fed back to it. That time counts
+    // from startResponseWait() if called, so wire time of large writes is
+    // neither measured nor charged against the estimated deadline.
+    class Transaction
+    {
+    public:
+        Transaction(BufferedAT& _at, uint32_t _timeoutMs, TxPriority priority = TX_PRIORITY_CONTROL,
+                    RttEstimator* _rtt = nullptr)
+            : at(_at),
+              rtt(nullptr)
+        {
+            at.lock(priority);
+            if(at.transactionDepth++ == 0)
+            {
+                rtt = _rtt;
+                at.transactionCeiling = _timeoutMs;
+                at.transactionTimeout = rtt ? rtt->timeout(_timeoutMs) : _timeoutMs;
+                at.responseStart = 0;
+                at.transactionTimer.reset();
+                at.transactionTimer.start();
+            }
+        }
+
+        ~Transaction()
+        {
+            if(--at.transactionDepth == 0)
+            {
+                at.transactionTimer.stop();
+                if(rtt && !at.aborted)
+                {
+                    uint32_t elapsed = at.transactionTimer.read_ms();
+                    if(elapsed < at.responseDeadline())
+                    {
+                        // answered, even if with an error
+                        rtt->sample(elapsed - at.responseStart);
+                    }
+                    else
+                    {
+                        rtt->timedOut();
+                    }
+                }
+            }
+            at.unlock();
+        }
+
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+
+    private:
+        BufferedAT& at;
+        RttEstimator* rtt;
+    };
+
+    // Shortens the deadline of the transaction in progress to timeoutMs from
+    // now while it exists, e.g. for a quick first attempt that has to leave
+    // time for a fallback. Never extends it.
+    class Deadline
+    {
+    public:
+        Deadline(BufferedAT& _at, uint32_t timeoutMs)
+            : at(_at),
+              ceiling(_at.transactionCeiling)
+        {
+            uint32_t limit = at.transactionTimer.read_ms() + timeoutMs;
+            if(limit < at.transactionCeiling)
+            {
+                at.transactionCeiling = limit;
+            }
+        }
+
+        ~Deadline()
+        {
+            at.transactionCeiling = ceiling;
+        }
+
+        Deadline(const Deadline&) = delete;
+        Deadline& operator=(const Deadline&) = delete;
+
+    private:
+        BufferedAT& at;
+        uint32_t ceiling;
+    };
+
+    // UART, SPI or any other link to the module, see transport.h
+    explicit BufferedAT(Transport& _transport)
+        : transport(_transport),
+          oob(osPriorityHigh, MBED_CONF_GS1500M_RX_THREAD_STACK_SIZE),
+          ob(MBED_CONF_GS1500M_RX_BUFFER_SIZE),
+          rb(MBED_CONF_GS1500M_RESPONSE_BUFFER_SIZE),
+          sendHighWater(0),
+          transactionTimeout(READ_TIMEOUT),
+          transactionCeiling(READ_TIMEOUT),
+          responseStart(0),
+          transactionDepth(0),
+          failureCount(0),
+          failed(-1),
+          lineUsed(0),
+          pushed(0),
+          aborted(false),
+          rxState(RX_HUNT),
+          rxFrame(nullptr),
+          rxHeaderUsed(0),
+          rxRemaining(0),
+          txHead(0),
+          txTail(0),
+          txActive(false),
+          txRingHighWater(0)
     {
         oob.start(callback(this, &BufferedAT::checkOob));
-        serial.attach(callback(this, &BufferedAT::bufferRx), mbed::SerialBase::RxIrq);
+        transport.attachRx(callback(this, &BufferedAT::received));
     }
 
     bool send(const char *command, ...)
@@ -62,7 +193,83 @@ public:
 
     bool recv(const char* sequence)
     {
-        return recveiveSequence(rb, sequence);
+        return match(sequence);
+    }
+
+    // Parses a response in one pass, elements as in responsegrammar.h.
+    // False when an element does not match before timeout.
+    template <typename... Elements>
+    bool match(const Elements&... elements)
+    {
+        startWait();
+        ResponseCursor in(callback(this, &BufferedAT::nextResponseChar));
+        bool res = matchElements(in, elements...);
+        if(in.hasPending())
+        {
+            // character that ended the last field belongs to whatever is read next
+            rb.rewind(1);
+            if(lineUsed > 0)
+            {
+                lineUsed--;
+            }
+        }
+        matchTimer.stop();
+        return res;
+    }
+
+    // Waits for whichever sequence comes first and returns its index, -1
+    // on timeout or when a failure sequence came first (see failure()).
+    int recvAny(std::initializer_list<const char*> sequences)
+    {
+        LiteralMatcher alternatives[MAX_ALTERNATIVES];
+        size_t count = 0;
+        for(const char* sequence : sequences)
+        {
+            if(count < MAX_ALTERNATIVES)
+            {
+                alternatives[count++] = LiteralMatcher(sequence);
+            }
+        }
+
+        startWait();
+        int res = -1;
+        int c;
+        while(res < 0 && (c = nextResponseChar()) >= 0)
+        {
+            for(size_t i = 0; i < count; i++)
+            {
+                if(alternatives[i].feed(c))
+                {
+                    res = i;
+                    break;
+                }
+            }
+        }
+        matchTimer.stop();
+        return res;
+    }
+
+    // A response line starting with any of these ends the wait in progress
+    // as soon as the line is complete instead of letting it run into its
+    // timeout. Text further into a line (SSIDs, scan output) never does.
+    void registerFailure(const char* prefix)
+    {
+        if(failureCount < MAX_FAILURE_SEQUENCES)
+        {
+            failures[failureCount++] = prefix;
+        }
+    }
+
+    // index of the failure prefix that ended the last wait, -1 if none
+    int failure()
+    {
+        return failed;
+    }
+
+    // start of the line that ended the last wait as failure, without CR/LF
+    const char* failureLine()
+    {
+        return (failed >= 0) ? line : "";
     }
 
     void registerSequence(const std::string& _sequence, Callback<void()> callback)
@@ -70,20 +277,47 @@ public:
         specialSequences.emplace_back(std::make_pair(SpecialSequence(_sequence), callback));
     }
 
+    // Length prefixed data frame <prefix><header><payload>, e.g. <ESC>Z.
+    // header gets the headerLength bytes after prefix and returns payload
+    // length, negative for a malformed header. Payload goes to data in
+    // chunks, bypassing sequence matching and the response buffer, then end
+    // is called. Matching resumes with a clean state after the frame.
+    void registerFrame(const std::string& prefix, size_t headerLength,
+                       Callback<int(const char*)> header,
+                       Callback<void(const char*, size_t)> data,
+                       Callback<void()> end)
+    {
+        frames.emplace_back(prefix, headerLength, header, data, end);
+    }
+
+    // Queues data for the transport and returns once all of it is in the
+    // ring, waiting only for ring space. 0 when the deadline passed first.
     size_t write(const char *data, size_t size)
     {
-        size_t i = 0;
         lock();
-        for(; i < size; ++i)
+        size_t queued = enqueue(data, size);
+        unlock();
+        return (queued == size) ? size : 0;
+    }
+
+    // Waits until everything queued is handed to the UART, within the
+    // transaction deadline.
+    bool waitTxIdle()
+    {
+        while(txActive)
         {
-            if(serial.putc(data[i]) < 0)
+            txFlags.clear(TX_IDLE_FLAG);
+            if(!txActive)
             {
-                i = 0;
                 break;
             }
+            uint32_t waitMs = txWaitMs();
+            if(waitMs == 0 || (txFlags.wait_any(TX_IDLE_FLAG, waitMs) & osFlagsError))
+            {
+                return !txActive;
+            }
         }
-        unlock();
-        return i;
+        return true;
     }
 
     size_t read(char *data, size_t size)
@@ -96,14 +330,51 @@ public:
         return read(ob, data, size);
     }
 
-    size_t readTill(char *data, size_t size, const char* delim)
+    // Reads one response line without its CR/LF. Characters not fitting
+    // into data are dropped. Returns line length or -1 on timeout or failure.
+    int readLine(char *data, size_t size)
+    {
+        size_t i = 0;
+        startWait();
+        while(true)
+        {
+            int c = nextResponseChar();
+            if(c < 0)
+            {
+                matchTimer.stop();
+                return -1;
+            }
+            if(c == '\n')
+            {
+                break;
+            }
+            if(c != '\r' && i + 1 < size)
+            {
+                data[i++] = c;
+            }
+        }
+        data[i] = '\0';
+        matchTimer.stop();
+        return i;
+    }
+
+    // Waits until the request is on the wire and starts the response time of
+    // the transaction from there. False when the ceiling passed first.
+    bool startResponseWait()
     {
-        return readTill(rb, data, size, delim);
+        bool res = waitTxIdle();
+        if(transactionDepth > 0 && mutex.ownedByCaller())
+        {
+            responseStart = transactionTimer.read_ms();
+        }
+        return res;
     }
 
-    void setTimeout(uint32_t _timeout)
+    // Makes the wait currently in progress (if any) fail immediately.
+    // Cleared by the next command sent.
+    void abortWait()
     {
-        timeout = _timeout;
+        aborted = true;
     }
 
     int readable(void)
@@ -113,19 +384,45 @@ public:
 
     int writeable(void)
     {
-        return 1;   // buffer allows overwriting by design, always true
+        return txUsed() < sizeof(txRing) - 1;
+    }
+
+    BufferedATUsage getUsage()
+    {
+        BufferedATUsage usage;
+        usage.rxBufferSize = ob.capacity();
+        usage.rxBufferHighWater = ob.maxUsed();
+        usage.rxBufferOverruns = ob.overrunCount();
+        usage.responseBufferSize = rb.capacity();
+        usage.responseBufferHighWater = rb.maxUsed();
+        usage.responseBufferOverruns = rb.overrunCount();
+        usage.txBufferSize = sizeof(sendBuffer);
+        usage.txBufferHighWater = sendHighWater;
+        usage.txRingSize = sizeof(txRing);
+        usage.txRingHighWater = txRingHighWater;
+        usage.rxStackSize = oob.stack_size();
+        usage.rxStackHighWater = oob.max_stack();
+        return usage;
+    }
+
+    TxQueueStats getQueueStats(TxPriority priority)
+    {
+        return mutex.getStats(priority);
     }
 
     void setBaud(uint32_t _baud)
     {
-        serial.baud(_baud);
+        // bytes still queued would go out at the new rate
+        lock();
+        waitTxIdle();
+        transport.setBaud(_baud);
+        unlock();
     }
 
 
 private:
-    void bufferRx()
+    void received(uint8_t data)
     {
-        uint8_t data = serial.getc();
         ob.push(data);
         pushed++;
         oob.signal_set(0x2);
@@ -138,7 +435,54 @@ private:
             rtos::Thread::signal_wait(0x2);
             while(!ob.empty())
             {
+                if(rxState == RX_PAYLOAD)
+                {
+                    char chunk[RX_CHUNK_SIZE];
+                    size_t n = 0;
+                    while(n < sizeof(chunk) && n < rxRemaining && !ob.empty())
+                    {
+                        chunk[n++] = ob.pop();
+                    }
+                    rxRemaining -= n;
+                    rxFrame->data(chunk, n);
+                    if(rxRemaining == 0)
+                    {
+                        endFrame();
+                    }
+                    continue;
+                }
+
                 uint8_t data = ob.pop();
+                if(rxState == RX_HEADER)
+                {
+                    rxHeader[rxHeaderUsed++] = data;
+                    if(rxHeaderUsed == rxFrame->headerLength)
+                    {
+                        rxHeader[rxHeaderUsed] = '\0';
+                        int length = rxFrame->header(rxHeader);
+                        if(length < 0)
+                        {
+                            // no idea where payload ends, hunt for next frame
+                            resetMatching();
+                        }
+                        else if(length == 0)
+                        {
+                            endFrame();
+                        }
+                        else
+                        {
+                            rxRemaining = length;
+                            rxState = RX_PAYLOAD;
+                        }
+                    }
+                    continue;
+                }
+
+                if(startFrame(data))
+                {
+                    continue;
+                }
+
                 auto specialSequence = specialSequences.begin();
                 while(specialSequence != specialSequences.end())
                 {
@@ -155,32 +499,38 @@ private:
         }
     }
 
-    bool recveiveSequence(Buffer& source, const char* sequence)
+    bool startFrame(uint8_t data)
     {
-        bool res = false;
-
-        SpecialSequence seq(sequence);
-        Timer timer;
-        timer.start();
-        while(true)
+        for(Frame& frame : frames)
         {
-            int c = getc(source);
-            while((c < 0) && (static_cast<uint32_t>(timer.read_ms()) < timeout))
+            if(frame.prefix.feed(data))
             {
-                c = getc(source);
+                rxFrame = &frame;
+                rxHeaderUsed = 0;
+                rxState = RX_HEADER;
+                return true;
             }
+        }
+        return false;
+    }
 
-            if (c < 0)
-            {
-                break;
-            }
-            if(seq.feed(c))
-            {
-                res = true;
-                break;
-            }
+    void endFrame()
+    {
+        rxFrame->end();
+        resetMatching();
+    }
+
+    void resetMatching()
+    {
+        rxState = RX_HUNT;
+        for(Frame& frame : frames)
+        {
+            frame.prefix.reset();
+        }
+        for(auto& specialSequence : specialSequences)
+        {
+            specialSequence.first.reset();
         }
-        return res;
     }
 
     size_t read(Buffer& source, char *data, size_t size)
@@ -191,7 +541,7 @@ private:
         for( ; i < size; i++)
         {
             int c = getc(source);
-            while((c < 0) && (static_cast<uint32_t>(timer.read_ms()) < READ_TIMEOUT))
+            while((c < 0) && !waitExpired(source, timer))
             {
                 c = getc(source);
             }
@@ -205,32 +555,77 @@ private:
         return i;
     }
 
-    size_t readTill(Buffer& source, char *data, size_t size, const char* delim)
+    bool waitExpired(Buffer& source, Timer& timer)
     {
-        size_t i = 0;
-        size_t delimLen = std::strlen(delim);
-        Timer timer;
-        timer.start();
-        for( ; i < size; ++i)
+        if(&source == &rb)
         {
-            int c = getc(source);
-            while((c < 0) && (static_cast<uint32_t>(timer.read_ms()) < READ_TIMEOUT))
+            // only command responses are abortable, OOB handlers keep reading data
+            if(aborted)
             {
-                c = getc(source);
+                return true;
             }
-            if(c < 0)
+            if(transactionDepth > 0 && mutex.ownedByCaller())
             {
-                return 0;
+                return static_cast<uint32_t>(transactionTimer.read_ms()) >= responseDeadline();
             }
-            data[i] = c;
-            if(i >= delimLen && std::strncmp(&data[i - delimLen + 1], delim, delimLen) == 0)
+        }
+        return static_cast<uint32_t>(timer.read_ms()) >= READ_TIMEOUT;
+    }
+
+    uint32_t responseDeadline()
+    {
+        uint32_t deadline = responseStart + transactionTimeout;
+        return (deadline < transactionCeiling) ? deadline : transactionCeiling;
+    }
+
+    void startWait()
+    {
+        failed = -1;
+        matchTimer.reset();
+        matchTimer.start();
+    }
+
+    int nextResponseChar()
+    {
+        if(failed >= 0)
+        {
+            return -1;
+        }
+
+        int c = getc(rb);
+        while((c < 0) && !waitExpired(rb, matchTimer))
+        {
+            c = getc(rb);
+        }
+
+        if(c == '\n')
+        {
+            failed = failedLine();
+            lineUsed = 0;
+            if(failed >= 0)
             {
-                data[i] = '\0';
-                break;
+                return -1;
             }
+        }
+        else if(c >= 0 && c != '\r' && lineUsed + 1 < sizeof(line))
+        {
+            line[lineUsed++] = c;
+        }
+        return c;
+    }
 
+    // index of the failure prefix the completed line starts with, -1 if none
+    int failedLine()
+    {
+        line[lineUsed] = '\0';
+        for(size_t i = 0; i < failureCount; i++)
+        {
+            if(std::strncmp(line, failures[i], std::strlen(failures[i])) == 0)
+            {
+                return i;
+            }
         }
-        return i;
+        return -1;
     }
 
     int getc(Buffer& source)
@@ -247,28 +642,128 @@ private:
 
     bool vsend(const char *format, va_list args)
     {
-        if(vsprintf(sendBuffer, format, args) < 0)
+        lock();
+        aborted = false;
+        // whatever is left of earlier responses must not end this wait
+        rb.clear();
+        lineUsed = 0;
+        int len = vsnprintf(sendBuffer, sizeof(sendBuffer), format, args);
+        if(len < 0 || static_cast<size_t>(len) >= sizeof(sendBuffer))
         {
+            unlock();
             return false;
         }
+        if(static_cast<size_t>(len) > sendHighWater)
+        {
+            sendHighWater = len;
+        }
 
-        int i = 0;
-        lock();
-        for( ; sendBuffer[i]; i++)
+        bool res = (enqueue(sendBuffer, len) == static_cast<size_t>(len));
+        unlock();
+        return res && len > 0;
+    }
+
+    size_t txUsed()
+    {
+        size_t head = txHead;
+        size_t tail = txTail;
+        return (head >= tail) ? (head - tail) : (sizeof(txRing) - tail + head);
+    }
+
+    uint32_t txWaitMs()
+    {
+        if(transactionDepth > 0 && mutex.ownedByCaller())
+        {
+            // sending is bounded by the ceiling only, see startResponseWait()
+            uint32_t elapsed = transactionTimer.read_ms();
+            return (elapsed < transactionCeiling) ? (transactionCeiling - elapsed) : 0;
+        }
+        return READ_TIMEOUT;
+    }
+
+    // caller holds the lock, so this is the only producer
+    size_t enqueue(const char* data, size_t size)
+    {
+        size_t done = 0;
+        while(done < size)
         {
-            if(serial.putc(sendBuffer[i]) < 0)
+            size_t space = sizeof(txRing) - 1 - txUsed();
+            if(space == 0)
             {
-                i = 0;
-                break;
+                // flag cleared before the check so a drain in between is not missed
+                txFlags.clear(TX_SPACE_FLAG);
+                if(txUsed() < sizeof(txRing) - 1)
+                {
+                    continue;
+                }
+                uint32_t waitMs = txWaitMs();
+                if(waitMs == 0 || (txFlags.wait_any(TX_SPACE_FLAG, waitMs) & osFlagsError))
+                {
+                    break;
+                }
+                continue;
+            }
+
+            size_t head = txHead;
+            for(size_t n = std::min(space, size - done); n > 0; n--)
+            {
+                txRing[head] = data[done++];
+                head = (head + 1 < sizeof(txRing)) ? head + 1 : 0;
             }
+            txHead = head;
+            if(txUsed() > txRingHighWater)
+            {
+                txRingHighWater = txUsed();
+            }
+            startTx();
         }
-        unlock();
-        return (i != 0);
+        return done;
+    }
+
+    void startTx()
+    {
+        core_util_critical_section_enter();
+        if(!txActive)
+        {
+            pumpTx();
+            if(txTail != txHead)
+            {
+                txActive = true;
+                transport.attachTx(callback(this, &BufferedAT::txIrq));
+            }
+        }
+        core_util_critical_section_exit();
     }
 
-    void lock()
+    void pumpTx()
     {
-        mutex.lock();
+        while(txTail != txHead && transport.writeable())
+        {
+            transport.putc(txRing[txTail]);
+            txTail = (txTail + 1 < sizeof(txRing)) ? txTail + 1 : 0;
+        }
+    }
+
+    // UART interrupt or transport thread (SPI, pipe); the critical section
+    // keeps enqueue() from adding data between the empty check and clearing
+    // txActive, which would leave it in the ring with nobody sending it
+    void txIrq()
+    {
+        core_util_critical_section_enter();
+        pumpTx();
+        if(txTail == txHead)
+        {
+            transport.attachTx(nullptr);
+            txActive = false;
+            txFlags.set(TX_IDLE_FLAG);
+        }
+        core_util_critical_section_exit();
+        txFlags.set(TX_SPACE_FLAG);
+    }
+
+    void lock(TxPriority priority = TX_PRIORITY_CONTROL)
+    {
+        mutex.lock(priority);
     }
 
     void unlock()
@@ -277,14 +772,68 @@ private:
     }
 
 private:
-    RawSerial serial;
+    Transport& transport;
     Thread oob;
     Buffer ob;
     Buffer rb;
-    char sendBuffer[2*1512];
-
-    uint32_t timeout;
+    char sendBuffer[MBED_CONF_GS1500M_TX_BUFFER_SIZE];
+    size_t sendHighWater;
+
+    Timer matchTimer;
+    Timer transactionTimer;
+    uint32_t transactionTimeout;  // allowed response time, estimated or ceiling
+    uint32_t transactionCeiling;
+    uint32_t responseStart;       // ms into the transaction the response time counts from
+    uint32_t transactionDepth;
+    const char* failures[MAX_FAILURE_SEQUENCES];
+    size_t failureCount;
+    int failed;
+    char line[MAX_FAILURE_LINE];  // start of the response line being read
+    size_t lineUsed;
     volatile int pushed;
-    PlatformMutex mutex;
+    volatile bool aborted;
+    TxScheduler mutex;
     std::vector<std::pair<SpecialSequence, Callback<void()>>> specialSequences;
+
+    struct Frame
+    {
+        Frame(const std::string& _prefix, size_t _headerLength,
+              Callback<int(const char*)> _header,
+              Callback<void(const char*, size_t)> _data,
+              Callback<void()> _end)
+            : prefix(_prefix),
+              headerLength(_headerLength < MAX_FRAME_HEADER ? _headerLength : MAX_FRAME_HEADER),
+              header(_header),
+              data(_data),
+              end(_end)
+        {}
+
+        SpecialSequence prefix;
+        size_t headerLength;
+        Callback<int(const char*)> header;
+        Callback<void(const char*, size_t)> data;
+        Callback<void()> end;
+    };
+
+    enum RxState
+    {
+        RX_HUNT,    // matching sequences and frame prefixes, feeding rb
+        RX_HEADER,  // collecting frame header
+        RX_PAYLOAD  // copying frame payload
+    };
+
+    std::vector<Frame> frames;
+    RxState rxState;
+    Frame* rxFrame;
+    char rxHeader[MAX_FRAME_HEADER + 1];
+    size_t rxHeaderUsed;
+    size_t rxRemaining;
+
+    // written by lock holder, drained by transport TX notifications
+    char txRing[MBED_CONF_GS1500M_TX_RING_SIZE];
+    volatile size_t txHead;
+    volatile size_t txTail;
+    volatile bool txActive;
+    size_t txRingHighWater;
+    rtos::EventFlags txFlags;
 };
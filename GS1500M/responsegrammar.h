@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 2018 Slashdev SDG UG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include "Callback.h"
+
+// Building blocks of BufferedAT::match(). A response is described as a list
+// of literals and typed fields, e.g.
+//     parser.match("IP addr=", Ipv4Field(ip, sizeof(ip)), "OK")
+// and parsed in one pass over the response buffer. A literal skips input up
+// to and including its text. A field skips leading whitespace, consumes what it
+// accepts and leaves the first other character to the next element.
+
+// Response characters with one character of lookahead, -1 on timeout.
+class ResponseCursor
+{
+public:
+    explicit ResponseCursor(mbed::Callback<int()> _next)
+        : next(_next),
+          pending(-1)
+    {}
+
+    int peek()
+    {
+        if(pending < 0)
+        {
+            pending = next();
+        }
+        return pending;
+    }
+
+    int get()
+    {
+        int c = peek();
+        pending = -1;
+        return c;
+    }
+
+    bool hasPending()
+    {
+        return pending >= 0;
+    }
+
+private:
+    mbed::Callback<int()> next;
+    int pending;
+};
+
+// Incremental search for a literal; unlike SpecialSequence it does not lose
+// a match starting inside a failed partial one ("OOK" still finds "OK").
+class LiteralMatcher
+{
+public:
+    LiteralMatcher()
+        : literal(""),
+          len(0),
+          matched(0)
+    {}
+
+    explicit LiteralMatcher(const char* _literal)
+        : literal(_literal),
+          len(std::strlen(_literal)),
+          matched(0)
+    {}
+
+    bool feed(char c)
+    {
+        while(matched > 0 && literal[matched] != c)
+        {
+            // longest suffix of matched part that is also a prefix
+            size_t k = matched - 1;
+            while(k > 0 && std::strncmp(literal + matched - k, literal, k) != 0)
+            {
+                k--;
+            }
+            matched = k;
+        }
+        if(literal[matched] == c)
+        {
+            matched++;
+        }
+        return matched == len;
+    }
+
+    size_t length()
+    {
+        return len;
+    }
+
+    void reset()
+    {
+        matched = 0;
+    }
+
+private:
+    const char* literal;
+    size_t len;
+    size_t matched;
+};
+
+// Literal that only matches at the start of a line, so "CONNECT " is not
+// found inside "DISCONNECT ". The wait is taken to start at a line start.
+struct LineLiteral
+{
+    explicit LineLiteral(const char* _literal) : literal(_literal) {}
+    const char* literal;
+};
+
+// Dotted decimal address, copied as text
+struct Ipv4Field
+{
+    Ipv4Field(char* _out, size_t _size) : out(_out), size(_size) {}
+    char* out;
+    size_t size;
+};
+
+// xx:xx:xx:xx:xx:xx as text and/or as 6 bytes, either may be null
+struct MacField
+{
+    MacField(char* _out, size_t _size, uint8_t* _bytes = nullptr) : out(_out), size(_size), bytes(_bytes) {}
+    char* out;
+    size_t size;
+    uint8_t* bytes;
+};
+
+// Optionally negative decimal number
+struct IntField
+{
+    explicit IntField(int& _out) : out(_out) {}
+    int& out;
+};
+
+// Hexadecimal number, e.g. a CID
+struct HexField
+{
+    explicit HexField(int& _out) : out(_out) {}
+    int& out;
+};
+
+// Text up to (not including) literal, which is consumed. Fails when the
+// text does not fit into out.
+struct UntilField
+{
+    UntilField(char* _out, size_t _size, const char* _literal) : out(_out), size(_size), literal(_literal) {}
+    char* out;
+    size_t size;
+    const char* literal;
+};
+
+inline void skipWhitespace(ResponseCursor& in)
+{
+    while(in.peek() == ' ' || in.peek() == '\r' || in.peek() == '\n')
+    {
+        in.get();
+    }
+}
+
+inline int hexValue(int c)
+{
+    if(c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if(c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if(c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+inline bool matchElement(ResponseCursor& in, const char* literal)
+{
+    LiteralMatcher matcher(literal);
+    if(matcher.length() == 0)
+    {
+        return true;
+    }
+
+    int c;
+    while((c = in.get()) >= 0)
+    {
+        if(matcher.feed(c))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool matchElement(ResponseCursor& in, const LineLiteral& field)
+{
+    size_t len = std::strlen(field.literal);
+    size_t matched = 0;
+    bool lineStart = true;
+    int c;
+    while(len > 0 && (c = in.get()) >= 0)
+    {
+        if(c == '\n')
+        {
+            lineStart = true;
+            matched = 0;
+        }
+        else if(c != '\r' && lineStart)
+        {
+            if(field.literal[matched] != c)
+            {
+                lineStart = false;
+            }
+            else if(++matched == len)
+            {
+                return true;
+            }
+        }
+    }
+    return len == 0;
+}
+
+inline bool matchElement(ResponseCursor& in, const Ipv4Field& field)
+{
+    skipWhitespace(in);
+    size_t i = 0;
+    int dots = 0;
+    int digits = 0;
+    int octet = 0;
+    while(true)
+    {
+        int c = in.peek();
+        if(c >= '0' && c <= '9')
+        {
+            octet = 10 * octet + (c - '0');
+            if(++digits > 3 || octet > 255)
+            {
+                return false;
+            }
+        }
+        else if(c == '.' && digits > 0 && dots < 3)
+        {
+            dots++;
+            digits = 0;
+            octet = 0;
+        }
+        else
+        {
+            break;
+        }
+
+        if(i + 1 >= field.size)
+        {
+            return false;
+        }
+        field.out[i++] = in.get();
+    }
+    field.out[i] = '\0';
+    return dots == 3 && digits > 0;
+}
+
+inline bool matchElement(ResponseCursor& in, const MacField& field)
+{
+    skipWhitespace(in);
+    char text[18];
+    for(size_t i = 0; i < sizeof(text) - 1; i++)
+    {
+        int c = in.peek();
+        bool separator = (i % 3 == 2);
+        if(separator ? (c != ':') : (hexValue(c) < 0))
+        {
+            return false;
+        }
+        text[i] = in.get();
+    }
+    text[sizeof(text) - 1] = '\0';
+
+    if(field.out)
+    {
+        if(field.size < sizeof(text))
+        {
+            return false;
+        }
+        std::memcpy(field.out, text, sizeof(text));
+    }
+    if(field.bytes)
+    {
+        for(int i = 0; i < 6; i++)
+        {
+            field.bytes[i] = (hexValue(text[3 * i]) << 4) | hexValue(text[3 * i + 1]);
+        }
+    }
+    return true;
+}
+
+inline bool matchElement(ResponseCursor& in, const IntField& field)
+{
+    skipWhitespace(in);
+    bool negative = false;
+    if(in.peek() == '-')
+    {
+        negative = true;
+        in.get();
+    }
+
+    int value = 0;
+    int digits = 0;
+    while(in.peek() >= '0' && in.peek() <= '9')
+    {
+        value = 10 * value + (in.get() - '0');
+        digits++;
+    }
+    field.out = negative ? -value : value;
+    return digits > 0;
+}
+
+inline bool matchElement(ResponseCursor& in, const HexField& field)
+{
+    skipWhitespace(in);
+    int value = 0;
+    int digits = 0;
+    while(hexValue(in.peek()) >= 0 && digits < 8)
+    {
+        value = (value << 4) | hexValue(in.get());
+        digits++;
+    }
+    field.out = value;
+    return digits > 0;
+}
+
+inline bool matchElement(ResponseCursor& in, const UntilField& field)
+{
+    LiteralMatcher matcher(field.literal);
+    size_t total = 0;
+    int c;
+    while((c = in.get()) >= 0)
+    {
+        if(total + 1 < field.size)
+        {
+            field.out[total] = c;
+        }
+        total++;
+        if(matcher.feed(c))
+        {
+            size_t len = total - matcher.length();
+            if(len + 1 > field.size)
+            {
+                return false;
+            }
+            field.out[len] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool matchElements(ResponseCursor& in)
+{
+    return true;
+}
+
+template <typename First, typename... Rest>
+bool matchElements(ResponseCursor& in, const First& first, const Rest&... rest)
+{
+    return matchElement(in, first) && matchElements(in, rest...);
+}
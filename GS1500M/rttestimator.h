@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2018 Slashdev SDG UG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+struct RttEstimate
+{
+    uint32_t srttMs;    // smoothed response time
+    uint32_t rttvarMs;  // smoothed mean deviation
+    uint32_t timeoutMs; // deadline currently derived, before ceiling
+    uint32_t floorMs;
+    uint32_t samples;
+    uint32_t timeouts;
+    uint32_t backoff;   // doublings applied after consecutive timeouts
+};
+
+// Response time estimation of one command class, as done for TCP RTO
+// (RFC 6298): timeout = SRTT + 4 * RTTVAR, doubled on every timeout until
+// the next answer arrives, clamped between floor and the ceiling the caller
+// passes. Without samples the ceiling is used as is.
+class RttEstimator
+{
+public:
+    RttEstimator()
+        : srtt8(0),
+          rttvar4(0),
+          floor(0),
+          samples(0),
+          timeouts(0),
+          backoff(0)
+    {}
+
+    void setFloor(uint32_t floorMs)
+    {
+        floor = floorMs;
+    }
+
+    uint32_t timeout(uint32_t ceilingMs)
+    {
+        if(samples == 0)
+        {
+            return ceilingMs;
+        }
+
+        uint64_t rto = static_cast<uint64_t>(rawTimeout()) << backoff;
+        if(rto < floor)
+        {
+            rto = floor;
+        }
+        return (rto < ceilingMs) ? rto : ceilingMs;
+    }
+
+    void sample(uint32_t rttMs)
+    {
+        // fixed point as in BSD: srtt8 = 8 * SRTT, rttvar4 = 4 * RTTVAR
+        if(samples == 0)
+        {
+            srtt8 = rttMs << 3;
+            rttvar4 = rttMs << 1;
+        }
+        else
+        {
+            int32_t err = static_cast<int32_t>(rttMs) - static_cast<int32_t>(srtt8 >> 3);
+            srtt8 += err;
+            if(err < 0)
+            {
+                err = -err;
+            }
+            rttvar4 += err - static_cast<int32_t>(rttvar4 >> 2);
+        }
+        samples++;
+        backoff = 0;
+    }
+
+    void timedOut()
+    {
+        timeouts++;
+        if(backoff < MAX_BACKOFF)
+        {
+            backoff++;
+        }
+    }
+
+    RttEstimate get()
+    {
+        RttEstimate estimate;
+        estimate.srttMs = srtt8 >> 3;
+        estimate.rttvarMs = rttvar4 >> 2;
+        estimate.timeoutMs = (samples == 0) ? 0 : timeout(UINT32_MAX);
+        estimate.floorMs = floor;
+        estimate.samples = samples;
+        estimate.timeouts = timeouts;
+        estimate.backoff = backoff;
+        return estimate;
+    }
+
+private:
+    uint32_t rawTimeout()
+    {
+        // at least 1 ms of variance so a perfectly steady link keeps some margin
+        uint32_t var = rttvar4 > 0 ? rttvar4 : 1;
+        return (srtt8 >> 3) + var;
+    }
+
+    static const uint32_t MAX_BACKOFF = 6;
+
+    int32_t srtt8;
+    int32_t rttvar4;
+    uint32_t floor;
+    uint32_t samples;
+    uint32_t timeouts;
+    uint32_t backoff;
+};
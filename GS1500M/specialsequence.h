@@ -36,7 +36,8 @@ public:
         }
         else
         {
-            seqIdx = 0;
+            // may be the start of the next occurrence, e.g. "\n\n8 "
+            seqIdx = (sequence[0] == _newChar) ? 1 : 0;
         }
 
         if(seqIdx == len)
@@ -47,6 +48,11 @@ public:
         return wholeMatched;
     }
 
+    void reset()
+    {
+        seqIdx = 0;
+    }
+
 private:
     const std::string sequence;
     const size_t len;
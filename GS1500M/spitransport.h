@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2018 Slashdev SDG UG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "transport.h"
+#include "buffer.h"
+#include "SPI.h"
+#include "DigitalOut.h"
+#include "InterruptIn.h"
+#include "Thread.h"
+#include "EventFlags.h"
+
+// GS1500M SPI host interface byte stuffing: the link is full duplex, both
+// sides clock IDLE when they have nothing to say and escape data bytes
+// that collide with control characters as ESC, byte ^ 0x20.
+const uint8_t GS_SPI_IDLE = 0xF5;
+const uint8_t GS_SPI_ESC = 0xFB;
+const uint8_t GS_SPI_XON = 0xFA;
+const uint8_t GS_SPI_XOFF = 0xFD;
+const uint8_t GS_SPI_LINK_READY = 0xF3;
+const uint8_t GS_SPI_LINK_INACTIVE = 0xFF;
+const uint8_t GS_SPI_LINK_INACTIVE_ZERO = 0x00;
+const uint8_t GS_SPI_ESC_XOR = 0x20;
+
+const uint32_t SPI_WORK_FLAG = 0x1;
+const size_t SPI_TX_FIFO_SIZE = 64;
+const uint32_t SPI_THREAD_STACK_SIZE = 1024;
+
+// SPI master towards the module. A thread clocks bytes while there is
+// something to send or the module raises its data ready line; writes and
+// the data ready interrupt wake it up.
+class SpiTransport : public Transport
+{
+public:
+    SpiTransport(PinName mosi, PinName miso, PinName sclk, PinName cs, PinName dataReady,
+                 int frequency = 3500000)
+        : spi(mosi, miso, sclk),
+          chipSelect(cs, 1),
+          ready(dataReady),
+          thread(osPriorityHigh, SPI_THREAD_STACK_SIZE),
+          txFifo(SPI_TX_FIFO_SIZE),
+          txEscaped(-1),
+          rxEscape(false),
+          xoff(false)
+    {
+        spi.format(8, 0);
+        spi.frequency(frequency);
+        ready.rise(mbed::callback(this, &SpiTransport::wake));
+        thread.start(mbed::callback(this, &SpiTransport::run));
+    }
+
+    virtual void attachRx(mbed::Callback<void(uint8_t)> _rx)
+    {
+        rx = _rx;
+    }
+
+    virtual void attachTx(mbed::Callback<void()> _tx)
+    {
+        tx = _tx;
+    }
+
+    virtual bool writeable()
+    {
+        return txFifo.size() < txFifo.capacity() - 1;
+    }
+
+    virtual void putc(uint8_t c)
+    {
+        txFifo.push(c);
+        wake();
+    }
+
+private:
+    void wake()
+    {
+        flags.set(SPI_WORK_FLAG);
+    }
+
+    static bool special(uint8_t c)
+    {
+        return c == GS_SPI_IDLE || c == GS_SPI_ESC || c == GS_SPI_XON || c == GS_SPI_XOFF
+               || c == GS_SPI_LINK_READY || c == GS_SPI_LINK_INACTIVE || c == GS_SPI_LINK_INACTIVE_ZERO;
+    }
+
+    bool txPending()
+    {
+        return !xoff && (txEscaped >= 0 || !txFifo.empty());
+    }
+
+    uint8_t nextTx()
+    {
+        if(xoff)
+        {
+            return GS_SPI_IDLE;
+        }
+        if(txEscaped >= 0)
+        {
+            uint8_t c = txEscaped;
+            txEscaped = -1;
+            return c;
+        }
+        if(txFifo.empty())
+        {
+            return GS_SPI_IDLE;
+        }
+
+        uint8_t c = txFifo.pop();
+        if(special(c))
+        {
+            txEscaped = c ^ GS_SPI_ESC_XOR;
+            return GS_SPI_ESC;
+        }
+        return c;
+    }
+
+    void received(uint8_t c)
+    {
+        if(rxEscape)
+        {
+            rxEscape = false;
+            if(rx)
+            {
+                rx(c ^ GS_SPI_ESC_XOR);
+            }
+            return;
+        }
+
+        switch(c)
+        {
+            case GS_SPI_ESC:
+                rxEscape = true;
+                break;
+            case GS_SPI_XOFF:
+                xoff = true;
+                break;
+            case GS_SPI_XON:
+                xoff = false;
+                break;
+            case GS_SPI_IDLE:
+            case GS_SPI_LINK_READY:
+            case GS_SPI_LINK_INACTIVE:
+            case GS_SPI_LINK_INACTIVE_ZERO:
+                break;
+            default:
+                if(rx)
+                {
+                    rx(c);
+                }
+                break;
+        }
+    }
+
+    void run()
+    {
+        while(true)
+        {
+            // while flow controlled, poll for XON
+            flags.wait_any(SPI_WORK_FLAG, xoff ? 1 : osWaitForever);
+            spi.lock();
+            chipSelect = 0;
+            do
+            {
+                received(spi.write(nextTx()));
+                if(txFifo.empty())
+                {
+                    // copy, BufferedAT detaches from within the callback
+                    mbed::Callback<void()> refill = tx;
+                    if(refill)
+                    {
+                        refill();
+                    }
+                }
+            }
+            while(txPending() || ready.read());
+            chipSelect = 1;
+            spi.unlock();
+        }
+    }
+
+    mbed::SPI spi;
+    mbed::DigitalOut chipSelect;
+    mbed::InterruptIn ready;
+    rtos::Thread thread;
+    rtos::EventFlags flags;
+    Buffer txFifo;
+    mbed::Callback<void(uint8_t)> rx;
+    mbed::Callback<void()> tx;
+    int txEscaped;
+    bool rxEscape;
+    volatile bool xoff;
+};
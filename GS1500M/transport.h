@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2018 Slashdev SDG UG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "PinNames.h"
+#include "RawSerial.h"
+#include "Callback.h"
+#include "Thread.h"
+#include "EventFlags.h"
+#include "buffer.h"
+
+// Byte link between BufferedAT and the module. Received bytes are pushed
+// to the rx callback, transmission is pulled: while the tx callback is
+// attached it is called whenever writeable() may have become true and
+// feeds bytes with putc(). Both callbacks may run in interrupt context.
+class Transport
+{
+public:
+    virtual ~Transport() {}
+
+    virtual void attachRx(mbed::Callback<void(uint8_t)> rx) = 0;
+    // null stops the notifications
+    virtual void attachTx(mbed::Callback<void()> tx) = 0;
+    virtual bool writeable() = 0;
+    virtual void putc(uint8_t c) = 0;
+    // only meaningful for UART
+    virtual void setBaud(uint32_t baud) {}
+};
+
+class UartTransport : public Transport
+{
+public:
+    UartTransport(PinName tx, PinName rx, int baud)
+        : serial(tx, rx, baud)
+    {}
+
+    virtual void attachRx(mbed::Callback<void(uint8_t)> _rx)
+    {
+        rx = _rx;
+        serial.attach(mbed::callback(this, &UartTransport::rxIrq), mbed::SerialBase::RxIrq);
+    }
+
+    virtual void attachTx(mbed::Callback<void()> tx)
+    {
+        serial.attach(tx, mbed::SerialBase::TxIrq);
+    }
+
+    virtual bool writeable()
+    {
+        return serial.writeable();
+    }
+
+    virtual void putc(uint8_t c)
+    {
+        serial.putc(c);
+    }
+
+    virtual void setBaud(uint32_t baud)
+    {
+        serial.baud(baud);
+    }
+
+private:
+    void rxIrq()
+    {
+        rx(serial.getc());
+    }
+
+    mbed::RawSerial serial;
+    mbed::Callback<void(uint8_t)> rx;
+};
+
+const size_t PIPE_FIFO_SIZE = 256;
+const uint32_t PIPE_DATA_FLAG = 0x1;
+const uint32_t PIPE_THREAD_STACK_SIZE = 1024;
+
+// Host side transport without hardware, for running the driver against a
+// simulated module and in tests. Bytes written to one end are delivered to
+// the connected peer by this end's thread, never from within putc(), which
+// BufferedAT calls in a critical section. inject() delivers bytes as if the
+// peer sent them.
+class PipeTransport : public Transport
+{
+public:
+    PipeTransport()
+        : peer(nullptr),
+          thread(osPriorityHigh, PIPE_THREAD_STACK_SIZE),
+          fifo(PIPE_FIFO_SIZE)
+    {
+        thread.start(mbed::callback(this, &PipeTransport::run));
+    }
+
+    // both ends before anything is written
+    void connect(PipeTransport& other)
+    {
+        peer = &other;
+        other.peer = this;
+    }
+
+    void inject(const char* data, size_t size)
+    {
+        for(size_t i = 0; i < size; i++)
+        {
+            if(rx)
+            {
+                rx(data[i]);
+            }
+        }
+    }
+
+    virtual void attachRx(mbed::Callback<void(uint8_t)> _rx)
+    {
+        rx = _rx;
+    }
+
+    virtual void attachTx(mbed::Callback<void()> _tx)
+    {
+        tx = _tx;
+        if(tx)
+        {
+            // fifo may have drained before the callback was there
+            flags.set(PIPE_DATA_FLAG);
+        }
+    }
+
+    virtual bool writeable()
+    {
+        return fifo.size() < fifo.capacity() - 1;
+    }
+
+    virtual void putc(uint8_t c)
+    {
+        fifo.push(c);
+        flags.set(PIPE_DATA_FLAG);
+    }
+
+private:
+    void run()
+    {
+        while(true)
+        {
+            flags.wait_any(PIPE_DATA_FLAG);
+            while(!fifo.empty())
+            {
+                uint8_t c = fifo.pop();
+                if(peer && peer->rx)
+                {
+                    peer->rx(c);
+                }
+            }
+            // copy, BufferedAT detaches from within the callback
+            mbed::Callback<void()> refill = tx;
+            if(refill)
+            {
+                refill();
+            }
+        }
+    }
+
+    PipeTransport* peer;
+    rtos::Thread thread;
+    rtos::EventFlags flags;
+    Buffer fifo;
+    mbed::Callback<void(uint8_t)> rx;
+    mbed::Callback<void()> tx;
+};
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2018 Slashdev SDG UG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "Mutex.h"
+#include "ConditionVariable.h"
+#include "us_ticker_api.h"
+
+enum TxPriority
+{
+    TX_PRIORITY_REALTIME,   // latency critical socket data
+    TX_PRIORITY_BULK,       // regular socket data
+    TX_PRIORITY_CONTROL,    // connection management, DNS, socket setup
+    TX_PRIORITY_BACKGROUND, // status polls
+    TX_PRIORITY_COUNT
+};
+
+// time threads spent waiting for the UART, per priority class
+struct TxQueueStats
+{
+    uint32_t grants;
+    uint32_t maxUs;
+    uint64_t totalUs;
+};
+
+// Recursive lock handing the UART to waiting threads by priority class and,
+// within a class, in arrival order. A class that was passed over
+// STARVATION_LIMIT times in a row is served next regardless of priority.
+class TxScheduler
+{
+public:
+    static const uint32_t STARVATION_LIMIT = 4;
+
+    TxScheduler()
+        : cond(guard),
+          granted(-1),
+          busy(false),
+          owner(nullptr),
+          depth(0)
+    {
+        for(int i = 0; i < TX_PRIORITY_COUNT; i++)
+        {
+            nextTicket[i] = 0;
+            servingTicket[i] = 0;
+            waiting[i] = 0;
+            bypassed[i] = 0;
+            stats[i] = {0, 0, 0};
+        }
+    }
+
+    void lock(TxPriority priority)
+    {
+        osThreadId self = osThreadGetId();
+        guard.lock();
+        if(depth > 0 && owner == self)
+        {
+            depth++;
+            guard.unlock();
+            return;
+        }
+
+        uint32_t start = us_ticker_read();
+        uint32_t ticket = nextTicket[priority]++;
+        waiting[priority]++;
+        if(!busy && granted < 0)
+        {
+            grantNext();
+        }
+        while(granted != priority || servingTicket[priority] != ticket)
+        {
+            cond.wait();
+        }
+
+        granted = -1;
+        servingTicket[priority]++;
+        waiting[priority]--;
+        busy = true;
+        owner = self;
+        depth = 1;
+
+        uint32_t delay = us_ticker_read() - start;
+        stats[priority].grants++;
+        stats[priority].totalUs += delay;
+        if(delay > stats[priority].maxUs)
+        {
+            stats[priority].maxUs = delay;
+        }
+        guard.unlock();
+    }
+
+    void unlock()
+    {
+        guard.lock();
+        depth--;
+        if(depth == 0)
+        {
+            busy = false;
+            owner = nullptr;
+            grantNext();
+        }
+        guard.unlock();
+    }
+
+    bool ownedByCaller()
+    {
+        return (depth > 0) && (owner == osThreadGetId());
+    }
+
+    TxQueueStats getStats(TxPriority priority)
+    {
+        guard.lock();
+        TxQueueStats ret = stats[priority];
+        guard.unlock();
+        return ret;
+    }
+
+private:
+    // called with guard held
+    void grantNext()
+    {
+        int next = -1;
+        for(int i = 0; i < TX_PRIORITY_COUNT && next < 0; i++)
+        {
+            if(waiting[i] > 0 && bypassed[i] >= STARVATION_LIMIT)
+            {
+                next = i;
+            }
+        }
+        for(int i = 0; i < TX_PRIORITY_COUNT && next < 0; i++)
+        {
+            if(waiting[i] > 0)
+            {
+                next = i;
+            }
+        }
+
+        if(next < 0)
+        {
+            return;
+        }
+
+        for(int i = 0; i < TX_PRIORITY_COUNT; i++)
+        {
+            if(i == next)
+            {
+                bypassed[i] = 0;
+            }
+            else if(waiting[i] > 0)
+            {
+                bypassed[i]++;
+            }
+        }
+        granted = next;
+        cond.notify_all();
+    }
+
+private:
+    rtos::Mutex guard;
+    rtos::ConditionVariable cond;
+    uint32_t nextTicket[TX_PRIORITY_COUNT];
+    uint32_t servingTicket[TX_PRIORITY_COUNT];
+    uint32_t waiting[TX_PRIORITY_COUNT];
+    uint32_t bypassed[TX_PRIORITY_COUNT];
+    TxQueueStats stats[TX_PRIORITY_COUNT];
+    int granted;
+    bool busy;
+    volatile osThreadId owner;
+    volatile uint32_t depth;
+};
@@ -31,19 +31,63 @@
 
 const uint32_t GS1500M_CONNECT_TIMEOUT = 25000;
 const uint32_t GS1500M_SEND_TIMEOUT    = 500;
-const uint32_t GS1500M_RECV_TIMEOUT    = 500;
 const uint32_t GS1500M_MISC_TIMEOUT    = 500;
+const uint32_t GS1500M_ACCEPT_TIMEOUT  = 6553;
+const uint32_t GS1500M_SCAN_TIMEOUT    = 10000;
+const uint32_t GS1500M_TLS_TIMEOUT     = 15000;
+const uint32_t GS1500M_HTTP_TIMEOUT    = 10000;
+
+const uint32_t GS1500M_WORKER_STACK_SIZE = MBED_CONF_GS1500M_WORKER_STACK_SIZE;
+const uint32_t GS1500M_CONNECT_DONE_FLAG = 0x1;
+const int GS1500M_COALESCE_DELAY_DEFAULT = 20;
+const int GS1500M_ASYNC_SEND_DEPTH = MBED_CONF_GS1500M_ASYNC_SEND_DEPTH;
 
 using namespace std::placeholders;
 
 GS1500MInterface::GS1500MInterface(PinName tx,
                                    PinName rx,
-                                   int baud)
-    : gsat(tx, rx, baud)
+                                   int baud,
+                                   PinName reset,
+                                   PinName powerDown)
+    : GS1500MInterface(new UartTransport(tx, rx, 115200), true, reset, powerDown)
+{
+}
+
+GS1500MInterface::GS1500MInterface(Transport& transport,
+                                   PinName reset,
+                                   PinName powerDown)
+    : GS1500MInterface(&transport, false, reset, powerDown)
+{
+}
+
+GS1500MInterface::GS1500MInterface(Transport* transport,
+                                   bool owned,
+                                   PinName reset,
+                                   PinName powerDown)
+    : gsat(transport, owned, reset, powerDown),
+      ap_sec(NSAPI_SECURITY_NONE),
+      ap_ch(0),
+      ap_bssid_set(false),
+      fastReconnect(false),
+      blocking(true),
+      connectFast(false),
+      connectResult(NSAPI_ERROR_NO_CONNECTION),
+      connectPhase(GS1500M_CONNECT_PHASE_IDLE),
+      connectionStatus(NSAPI_STATUS_DISCONNECTED),
+      workerThread(osPriorityNormal, GS1500M_WORKER_STACK_SIZE),
+      workerStarted(false)
 {
     memset(_ids, 0, sizeof(_ids));
     memset(_cbs, 0, sizeof(_cbs));
+    memset(_sockets, 0, sizeof(_sockets));
+    memset(asyncGeneration, 0, sizeof(asyncGeneration));
+    memset(&connectStats, 0, sizeof(connectStats));
+    for(int i = 0; i < GS1500M_SOCKET_COUNT; i++)
+    {
+        flushScheduled[i] = false;
+    }
     gsat.attach(mbed::callback(this, &GS1500MInterface::event));
+    gsat.attachLink(mbed::callback(this, &GS1500MInterface::linkEvent));
 }
 
 int GS1500MInterface::connect(const char* ssid,
@@ -51,9 +95,10 @@ int GS1500MInterface::connect(const char* ssid,
                               nsapi_security_t security,
                               uint8_t channel)
 {
-    if(channel != 0)
+    int ret = set_channel(channel);
+    if(ret != NSAPI_ERROR_OK)
     {
-        return NSAPI_ERROR_UNSUPPORTED;
+        return ret;
     }
 
     set_credentials(ssid, pass, security);
@@ -62,31 +107,240 @@ int GS1500MInterface::connect(const char* ssid,
 
 int GS1500MInterface::connect()
 {
-    gsat.setTimeout(GS1500M_CONNECT_TIMEOUT);
+    if(connectPhase != GS1500M_CONNECT_PHASE_IDLE
+       && connectPhase != GS1500M_CONNECT_PHASE_DONE
+       && connectPhase != GS1500M_CONNECT_PHASE_FAILED)
+    {
+        return NSAPI_ERROR_BUSY;
+    }
 
-    if(!gsat.startup())
+    beginConnect();
+    if(!blocking)
     {
-        return NSAPI_ERROR_DEVICE_ERROR;
+        if(!startWorker() || workerQueue.call(this, &GS1500MInterface::connectAsyncStep) == 0)
+        {
+            finishConnect(NSAPI_ERROR_NO_MEMORY);
+            return NSAPI_ERROR_NO_MEMORY;
+        }
+        return NSAPI_ERROR_OK;
+    }
+
+    while(!connectStep())
+    {}
+
+    return connectResult;
+}
+
+void GS1500MInterface::beginConnect()
+{
+    memset(&connectStats, 0, sizeof(connectStats));
+    connectResult = NSAPI_ERROR_IN_PROGRESS;
+    connectFast = fastReconnect;
+    connectFlags.clear(GS1500M_CONNECT_DONE_FLAG);
+    connectTotal.reset();
+    connectTotal.start();
+    setPhase(fastReconnect ? GS1500M_CONNECT_PHASE_PROBE : GS1500M_CONNECT_PHASE_STARTUP);
+}
+
+void GS1500MInterface::connectAsyncStep()
+{
+    // one phase per event so that other work queued on the worker interleaves
+    if(!connectStep() && workerQueue.call(this, &GS1500MInterface::connectAsyncStep) == 0)
+    {
+        // queue full, nothing would ever run the next phase
+        finishConnect(NSAPI_ERROR_NO_MEMORY);
+    }
+}
+
+bool GS1500MInterface::connectStep()
+{
+    Timer phase;
+    phase.start();
+    bool ok = false;
+
+    switch(connectPhase)
+    {
+        case GS1500M_CONNECT_PHASE_PROBE:
+            ok = gsat.probe(GS1500M_MISC_TIMEOUT);
+            connectStats.probeMs = phase.read_ms();
+            // module lost its configuration, continue with full bring-up
+            connectFast = ok;
+            setPhase(ok ? GS1500M_CONNECT_PHASE_ASSOCIATE : GS1500M_CONNECT_PHASE_STARTUP);
+            break;
+
+        case GS1500M_CONNECT_PHASE_STARTUP:
+            ok = gsat.startup(GS1500M_CONNECT_TIMEOUT);
+            connectStats.startupMs = phase.read_ms();
+            if(!ok)
+            {
+                finishConnect(NSAPI_ERROR_DEVICE_ERROR);
+                break;
+            }
+            setPhase(GS1500M_CONNECT_PHASE_DHCP);
+            break;
+
+        case GS1500M_CONNECT_PHASE_DHCP:
+            ok = gsat.dhcp(true, GS1500M_CONNECT_TIMEOUT);
+            connectStats.dhcpMs = phase.read_ms();
+            if(!ok)
+            {
+                finishConnect(NSAPI_ERROR_DHCP_FAILURE);
+                break;
+            }
+            setPhase(GS1500M_CONNECT_PHASE_ASSOCIATE);
+            break;
+
+        case GS1500M_CONNECT_PHASE_ASSOCIATE:
+            // same SSID and passphrase make GS1500M::connect go through ATZ0
+            ok = gsat.connect(ap_ssid, ap_pass, ap_sec, ap_ch, ap_bssid_set ? ap_bssid : nullptr, GS1500M_CONNECT_TIMEOUT);
+            connectStats.associateMs = phase.read_ms();
+            connectStats.pinned = ok && gsat.wasPinned();
+            if(ok)
+            {
+                setPhase(GS1500M_CONNECT_PHASE_ADDRESS);
+            }
+            else
+            {
+                failPhase(NSAPI_ERROR_NO_CONNECTION);
+            }
+            break;
+
+        case GS1500M_CONNECT_PHASE_ADDRESS:
+            ok = (gsat.getIPAddress(GS1500M_CONNECT_TIMEOUT) != 0);
+            connectStats.ipMs = phase.read_ms();
+            if(ok)
+            {
+                connectStats.path = connectFast ? GS1500M_CONNECT_PATH_FAST : GS1500M_CONNECT_PATH_FULL;
+                finishConnect(NSAPI_ERROR_OK);
+            }
+            else
+            {
+                failPhase(NSAPI_ERROR_DHCP_FAILURE);
+            }
+            break;
+
+        default:
+            break;
     }
 
-    if(!gsat.dhcp(true))
+    return (connectPhase == GS1500M_CONNECT_PHASE_DONE)
+        || (connectPhase == GS1500M_CONNECT_PHASE_FAILED);
+}
+
+void GS1500MInterface::failPhase(int error)
+{
+    if(connectFast)
+    {
+        // fast path did not work out, fall back to full bring-up
+        connectFast = false;
+        setPhase(GS1500M_CONNECT_PHASE_STARTUP);
+    }
+    else
     {
-        return NSAPI_ERROR_DHCP_FAILURE;
+        finishConnect(error);
     }
+}
 
-    if(!gsat.connect(ap_ssid, ap_pass, ap_sec))
+void GS1500MInterface::finishConnect(int error)
+{
+    connectResult = error;
+    connectStats.totalMs = connectTotal.read_ms();
+    connectTotal.stop();
+    if(error == NSAPI_ERROR_OK)
+    {
+        connectPhase = GS1500M_CONNECT_PHASE_DONE;
+        setStatus(NSAPI_STATUS_GLOBAL_UP);
+    }
+    else
+    {
+        connectPhase = GS1500M_CONNECT_PHASE_FAILED;
+        setStatus(NSAPI_STATUS_DISCONNECTED);
+    }
+    connectFlags.set(GS1500M_CONNECT_DONE_FLAG);
+}
+
+void GS1500MInterface::setPhase(GS1500MConnectPhase phase)
+{
+    connectPhase = phase;
+    // status callback fires on every phase change, get_connect_phase() tells which
+    setStatus(NSAPI_STATUS_CONNECTING);
+}
+
+void GS1500MInterface::setStatus(nsapi_connection_status_t status)
+{
+    connectionStatus = status;
+    if(statusCallback)
+    {
+        statusCallback(NSAPI_EVENT_CONNECTION_STATUS_CHANGE, status);
+    }
+}
+
+bool GS1500MInterface::startWorker()
+{
+    if(!workerStarted)
+    {
+        workerStarted = (workerThread.start(mbed::callback(&workerQueue, &events::EventQueue::dispatch_forever)) == osOK);
+    }
+    return workerStarted;
+}
+
+int GS1500MInterface::get_socket_count()
+{
+    int count = 0;
+    for(int i = 0; i < GS1500M_SOCKET_COUNT; i++)
+    {
+        count += _ids[i];
+    }
+    return count;
+}
+
+int GS1500MInterface::wait_connected(uint32_t timeoutMs)
+{
+    if(connectPhase == GS1500M_CONNECT_PHASE_IDLE)
     {
         return NSAPI_ERROR_NO_CONNECTION;
     }
 
-    if(!gsat.getIPAddress())
+    uint32_t flags = connectFlags.wait_any(GS1500M_CONNECT_DONE_FLAG, timeoutMs, false);
+    if((flags & osFlagsError) || !(flags & GS1500M_CONNECT_DONE_FLAG))
     {
-        return NSAPI_ERROR_DHCP_FAILURE;
+        return NSAPI_ERROR_IN_PROGRESS;
     }
 
+    return connectResult;
+}
+
+GS1500MConnectPhase GS1500MInterface::get_connect_phase() const
+{
+    return connectPhase;
+}
+
+void GS1500MInterface::attach(mbed::Callback<void(nsapi_event_t, intptr_t)> status_cb)
+{
+    statusCallback = status_cb;
+}
+
+nsapi_connection_status_t GS1500MInterface::get_connection_status() const
+{
+    return connectionStatus;
+}
+
+nsapi_error_t GS1500MInterface::set_blocking(bool _blocking)
+{
+    blocking = _blocking;
     return NSAPI_ERROR_OK;
 }
 
+void GS1500MInterface::set_fast_reconnect(bool enabled)
+{
+    fastReconnect = enabled;
+}
+
+const GS1500MConnectStats& GS1500MInterface::get_connect_stats() const
+{
+    return connectStats;
+}
+
 int GS1500MInterface::set_credentials(const char* ssid, const char* pass, nsapi_security_t security)
 {
     memset(ap_ssid, 0, sizeof(ap_ssid));
@@ -102,24 +356,72 @@ int GS1500MInterface::set_credentials(const char* ssid, const char* pass, nsapi_
 
 nsapi_error_t GS1500MInterface::gethostbyname(const char* name, SocketAddress* address, nsapi_version_t version)
 {
-    gsat.setTimeout(10*GS1500M_MISC_TIMEOUT);
     char ipBuffer[16] = {0};
-    int ret = gsat.dnslookup(name, ipBuffer);
+    int ret = gsat.dnslookup(name, ipBuffer, 10*GS1500M_MISC_TIMEOUT);
     address->set_ip_address(ipBuffer);
     return (ret != 1);
 }
 
 int GS1500MInterface::set_channel(uint8_t channel)
 {
-    return NSAPI_ERROR_UNSUPPORTED;
+    // 2.4 GHz only, 0 lets the module pick
+    if(channel > 14)
+    {
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    ap_ch = channel;
+    return NSAPI_ERROR_OK;
+}
+
+int GS1500MInterface::set_bssid(const uint8_t* bssid)
+{
+    ap_bssid_set = (bssid != nullptr);
+    if(bssid)
+    {
+        memcpy(ap_bssid, bssid, sizeof(ap_bssid));
+    }
+    return NSAPI_ERROR_OK;
 }
 
 
 int GS1500MInterface::disconnect()
 {
-    gsat.setTimeout(GS1500M_MISC_TIMEOUT);
+    if(!gsat.disconnect(GS1500M_MISC_TIMEOUT))
+    {
+        return NSAPI_ERROR_DEVICE_ERROR;
+    }
+
+    connectPhase = GS1500M_CONNECT_PHASE_IDLE;
+    setStatus(NSAPI_STATUS_DISCONNECTED);
+    return NSAPI_ERROR_OK;
+}
+
+int GS1500MInterface::set_power_down(bool down)
+{
+    if(connectPhase != GS1500M_CONNECT_PHASE_IDLE
+       && connectPhase != GS1500M_CONNECT_PHASE_DONE
+       && connectPhase != GS1500M_CONNECT_PHASE_FAILED)
+    {
+        return NSAPI_ERROR_BUSY;
+    }
+
+    if(!gsat.setPowerDown(down, GS1500M_MISC_TIMEOUT))
+    {
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
 
-    if(!gsat.disconnect())
+    if(down)
+    {
+        connectPhase = GS1500M_CONNECT_PHASE_IDLE;
+        setStatus(NSAPI_STATUS_DISCONNECTED);
+    }
+    return NSAPI_ERROR_OK;
+}
+
+int GS1500MInterface::set_power_profile(GS1500MPowerProfile profile)
+{
+    if(!gsat.setPowerProfile(profile, GS1500M_MISC_TIMEOUT))
     {
         return NSAPI_ERROR_DEVICE_ERROR;
     }
@@ -127,34 +429,135 @@ int GS1500MInterface::disconnect()
     return NSAPI_ERROR_OK;
 }
 
+GS1500MPowerProfile GS1500MInterface::get_power_profile()
+{
+    return gsat.getPowerProfile();
+}
+
+void GS1500MInterface::set_latency_measurement(bool enabled)
+{
+    gsat.setLatencyMeasurement(enabled);
+}
+
+const GS1500MWakeLatency& GS1500MInterface::get_wake_latency(GS1500MPowerProfile profile)
+{
+    return gsat.getWakeLatency(profile);
+}
+
+TxQueueStats GS1500MInterface::get_tx_queue_stats(TxPriority priority)
+{
+    return gsat.getQueueStats(priority);
+}
+
+RttEstimate GS1500MInterface::get_rtt_estimate(GS1500MRttClass rttClass)
+{
+    return gsat.getRttEstimate(rttClass);
+}
+
+void GS1500MInterface::get_usage(GS1500MUsage& usage)
+{
+    gsat.getUsage(usage);
+    usage.workerStackSize = GS1500M_WORKER_STACK_SIZE;
+    usage.workerStackHighWater = workerStarted ? workerThread.max_stack() : 0;
+}
+
 const char* GS1500MInterface::get_ip_address()
 {
-    return gsat.getIPAddress();
+    return gsat.getIPAddress(GS1500M_MISC_TIMEOUT);
 }
 
 const char* GS1500MInterface::get_mac_address()
 {
-    return gsat.getMACAddress();
+    return gsat.getMACAddress(GS1500M_MISC_TIMEOUT);
 }
 
 const char* GS1500MInterface::get_gateway()
 {
-    return gsat.getGateway();
+    return gsat.getGateway(GS1500M_MISC_TIMEOUT);
 }
 
 const char* GS1500MInterface::get_netmask()
 {
-    return gsat.getNetmask();
+    return gsat.getNetmask(GS1500M_MISC_TIMEOUT);
 }
 
 int8_t GS1500MInterface::get_rssi()
 {
-    return gsat.getRSSI();
+    return gsat.getRSSI(GS1500M_MISC_TIMEOUT);
 }
 
 int GS1500MInterface::scan(WiFiAccessPoint* res, unsigned count)
 {
-    return gsat.scan(res, count);
+    return gsat.scan(res, count, GS1500M_SCAN_TIMEOUT);
+}
+
+int GS1500MInterface::scan(WiFiAccessPoint* res, unsigned count, mbed::Callback<void(const nsapi_wifi_ap_t&)> onAp)
+{
+    return gsat.scan(res, count, GS1500M_SCAN_TIMEOUT, onAp);
+}
+
+unsigned GS1500MInterface::get_scan_cache(GS1500MScanEntry* res, unsigned count)
+{
+    return gsat.getScanCache(res, count);
+}
+
+nsapi_error_t GS1500MInterface::add_certificate(const char* name, const void* der, unsigned length)
+{
+    if(!name || strlen(name) > GS1500M_CERT_NAME_SIZE || !der || length == 0)
+    {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    return gsat.addCertificate(name, der, length, GS1500M_MISC_TIMEOUT) ? NSAPI_ERROR_OK : NSAPI_ERROR_DEVICE_ERROR;
+}
+
+nsapi_error_t GS1500MInterface::remove_certificate(const char* name)
+{
+    return gsat.removeCertificate(name, GS1500M_MISC_TIMEOUT) ? NSAPI_ERROR_OK : NSAPI_ERROR_DEVICE_ERROR;
+}
+
+nsapi_error_t GS1500MInterface::http_configure(GS1500MHttpParam param, const char* value)
+{
+    return gsat.httpConfigure(param, value, GS1500M_MISC_TIMEOUT) ? NSAPI_ERROR_OK : NSAPI_ERROR_DEVICE_ERROR;
+}
+
+nsapi_error_t GS1500MInterface::http_open(const char* host, int port, bool tls, int& id)
+{
+    return gsat.httpOpen(host, port, tls, id, GS1500M_HTTP_TIMEOUT) ? NSAPI_ERROR_OK : NSAPI_ERROR_DEVICE_ERROR;
+}
+
+int GS1500MInterface::http_request(int id, GS1500MHttpMethod method, const char* path, const void* body, unsigned length)
+{
+    if(id < 0 || id >= GS1500M_SOCKET_COUNT)
+    {
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    int status = gsat.httpRequest(id, method, path, body, length, GS1500M_HTTP_TIMEOUT);
+    if(status < 0)
+    {
+        return socket_error(id);
+    }
+    return status;
+}
+
+int GS1500MInterface::http_read(int id, void* data, unsigned size)
+{
+    if(id < 0 || id >= GS1500M_SOCKET_COUNT)
+    {
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    int32_t recv = gsat.recv(id, data, size);
+    if(recv < 0)
+    {
+        return NSAPI_ERROR_WOULD_BLOCK;
+    }
+    return recv;
+}
+
+nsapi_error_t GS1500MInterface::http_close(int id)
+{
+    return gsat.httpClose(id, GS1500M_MISC_TIMEOUT) ? NSAPI_ERROR_OK : NSAPI_ERROR_DEVICE_ERROR;
 }
 
 struct GS1500M_socket
@@ -164,8 +567,35 @@ struct GS1500M_socket
     nsapi_protocol_t proto;
     bool connected;
     SocketAddress addr;
+    bool coalesce;
+    int coalesceDelay;
+    TxPriority priority;
+    char tlsCa[GS1500M_CERT_NAME_SIZE + 1]; // empty for plain TCP
+    // module options, -1 leaves module default; applied once there is a CID
+    int keepalive;
+    int keepIdleS;
+    int sndbuf;
+    int rcvbuf;
+    int nodelay;
+    int lastError;
+    bool pooled;
+    bool reused;  // connection came from the pool
+    bool bound;   // listening or bound UDP, owns idgs without being connected
+    // async mode when async.done is set; ring of copied send data
+    GS1500MAsyncSend async;
+    char* asyncData[GS1500M_ASYNC_SEND_DEPTH];
+    unsigned asyncSize[GS1500M_ASYNC_SEND_DEPTH];
+    int asyncHead;
+    int asyncQueued;
+    bool asyncBusy; // worker is sending one taken off the ring
 };
 
+static int recordError(struct GS1500M_socket* socket, int error)
+{
+    socket->lastError = error;
+    return error;
+}
+
 int GS1500MInterface::socket_open(void** handle, nsapi_protocol_t proto)
 {
     return init_local_socket(handle, proto, 0);
@@ -200,6 +630,27 @@ int GS1500MInterface::init_local_socket(void** handle, nsapi_protocol_t proto, i
     socket->idgs = _idgs;
     socket->proto = proto;
     socket->connected = false;
+    socket->coalesce = false;
+    socket->coalesceDelay = GS1500M_COALESCE_DELAY_DEFAULT;
+    socket->priority = TX_PRIORITY_BULK;
+    socket->tlsCa[0] = '\0';
+    // Apparently, against GS documentation, SO_KEEPALIVE must be enabled
+    // for "default on" TCP_KEEPALIVE to really work!
+    socket->keepalive = (proto == NSAPI_TCP) ? 1 : -1;
+    socket->keepIdleS = -1;
+    socket->sndbuf = -1;
+    socket->rcvbuf = -1;
+    socket->nodelay = -1;
+    socket->lastError = NSAPI_ERROR_OK;
+    socket->pooled = false;
+    socket->reused = false;
+    socket->bound = false;
+    socket->async.queue = nullptr;
+    socket->async.done = nullptr;
+    socket->asyncHead = 0;
+    socket->asyncQueued = 0;
+    socket->asyncBusy = false;
+    _sockets[id] = socket;
     *handle = socket;
     return 0;
 }
@@ -208,9 +659,17 @@ int GS1500MInterface::socket_close(void* handle)
 {
     struct GS1500M_socket* socket = (struct GS1500M_socket*)handle;
     int err = 0;
-    gsat.setTimeout(GS1500M_MISC_TIMEOUT);
 
-    if(!gsat.close(socket->id))
+    dropAsync(socket);
+    // idgs of a socket that never got a CID is none of its business
+    if(socket->pooled && socket->connected)
+    {
+        if(!gsat.release(socket->idgs, GS1500M_MISC_TIMEOUT))
+        {
+            err = NSAPI_ERROR_DEVICE_ERROR;
+        }
+    }
+    else if((socket->connected || socket->bound) && !gsat.close(socket->idgs, GS1500M_MISC_TIMEOUT))
     {
         err = NSAPI_ERROR_DEVICE_ERROR;
     }
@@ -223,13 +682,13 @@ int GS1500MInterface::socket_close(void* handle)
 int GS1500MInterface::socket_bind(void* handle, const SocketAddress &addr)
 {
     struct GS1500M_socket* socket = (struct GS1500M_socket*)handle;
-    gsat.setTimeout(GS1500M_MISC_TIMEOUT);
 
     const char* proto = (socket->proto == NSAPI_UDP) ? "UDP" : "TCP";
-    if(!gsat.bind(proto, socket->idgs, addr.get_port()))
+    if(!gsat.bind(proto, socket->idgs, addr.get_port(), GS1500M_MISC_TIMEOUT))
     {
         return NSAPI_ERROR_DEVICE_ERROR;
     }
+    socket->bound = true;
     return 0;
 }
 
@@ -241,15 +700,41 @@ int GS1500MInterface::socket_listen(void* handle, int backlog)
 int GS1500MInterface::socket_connect(void* handle, const SocketAddress &addr)
 {
     struct GS1500M_socket* socket = (struct GS1500M_socket*)handle;
-    gsat.setTimeout(2*GS1500M_MISC_TIMEOUT);
 
-    const char* proto = (socket->proto == NSAPI_UDP) ? "UDP" : "TCP";
-    if(!gsat.open(proto, socket->idgs, addr.get_ip_address(), addr.get_port()))
+    if(socket->pooled && !socket->tlsCa[0])
     {
-        return NSAPI_ERROR_DEVICE_ERROR;
+        if(!gsat.acquire(addr.get_ip_address(), addr.get_port(), socket->idgs, socket->reused, 2*GS1500M_MISC_TIMEOUT))
+        {
+            return recordError(socket, NSAPI_ERROR_DEVICE_ERROR);
+        }
+    }
+    else
+    {
+        const char* proto = (socket->proto == NSAPI_UDP) ? "UDP" : "TCP";
+        if(!gsat.open(proto, socket->idgs, addr.get_ip_address(), addr.get_port(), 2*GS1500M_MISC_TIMEOUT))
+        {
+            return recordError(socket, NSAPI_ERROR_DEVICE_ERROR);
+        }
     }
 
+    // connected already, so setModuleOption() reaches the module; a reused
+    // CID gets this socket's options on top of what it was left with
     socket->connected = true;
+    nsapi_error_t err = applySocketOptions(socket);
+    if(err != NSAPI_ERROR_OK)
+    {
+        socket->connected = false;
+        gsat.close(socket->idgs, GS1500M_MISC_TIMEOUT);
+        return recordError(socket, err);
+    }
+
+    if(socket->tlsCa[0] && !gsat.openTls(socket->idgs, socket->tlsCa, GS1500M_TLS_TIMEOUT))
+    {
+        socket->connected = false;
+        gsat.close(socket->idgs, GS1500M_MISC_TIMEOUT);
+        return recordError(socket, NSAPI_ERROR_AUTH_FAILURE);
+    }
+
     socket->addr = addr;
     return 0;
 }
@@ -260,16 +745,22 @@ int GS1500MInterface::socket_accept(void* server, void** socket, SocketAddress*
 
     char clientAddress[100] = {};
     int clientSocketId;
-    gsat.setTimeout(6553);
-    if(!gsat.accept(servSocket->idgs, clientSocketId, clientAddress))
+    if(!gsat.accept(servSocket->idgs, clientSocketId, clientAddress, GS1500M_ACCEPT_TIMEOUT))
     {
         return NSAPI_ERROR_WOULD_BLOCK;
     }
 
     *addr = SocketAddress(clientAddress);
+    int err = init_local_socket(socket, servSocket->proto, clientSocketId);
+    if(err != 0)
+    {
+        gsat.close(clientSocketId, GS1500M_MISC_TIMEOUT);
+        return err;
+    }
     struct GS1500M_socket* clientSocket = (struct GS1500M_socket*)*socket;
-    init_local_socket(socket, servSocket->proto, clientSocketId);
     clientSocket->addr = *addr;
+    clientSocket->connected = true;
+    applySocketOptions(clientSocket);
     return 0;
 }
 
@@ -277,23 +768,173 @@ int GS1500MInterface::socket_send(void* handle, const void* data, unsigned size)
 {
     struct GS1500M_socket* socket = (struct GS1500M_socket*)handle;
 
-    gsat.setTimeout(GS1500M_SEND_TIMEOUT);
+    if(!socket->connected)
+    {
+        return NSAPI_ERROR_NO_CONNECTION;
+    }
+
+    if(socket->async.done)
+    {
+        asyncMutex.lock();
+        if(socket->asyncQueued + socket->asyncBusy >= GS1500M_ASYNC_SEND_DEPTH)
+        {
+            // sigio follows when the worker completes one
+            asyncMutex.unlock();
+            return NSAPI_ERROR_WOULD_BLOCK;
+        }
+        char* copy = new char[size];
+        memcpy(copy, data, size);
+        int slot = (socket->asyncHead + socket->asyncQueued) % GS1500M_ASYNC_SEND_DEPTH;
+        socket->asyncData[slot] = copy;
+        socket->asyncSize[slot] = size;
+        socket->asyncQueued++;
+        uint32_t generation = asyncGeneration[socket->id];
+        asyncMutex.unlock();
+
+        if(!startWorker() || workerQueue.call(this, &GS1500MInterface::drainAsync, socket->id, generation) == 0)
+        {
+            asyncMutex.lock();
+            socket->asyncQueued--;
+            delete[] copy;
+            asyncMutex.unlock();
+            return recordError(socket, NSAPI_ERROR_NO_MEMORY);
+        }
+        return size;
+    }
 
-    size_t sent = gsat.send(socket->idgs, data, size);
+    size_t sent = gsat.send(socket->idgs, data, size, GS1500M_SEND_TIMEOUT);
     if(sent == 0)
     {
-        return NSAPI_ERROR_DEVICE_ERROR;
+        return recordError(socket, socket_error(socket->idgs));
+    }
+
+    if(gsat.hasPending(socket->idgs) && !flushScheduled[socket->idgs] && startWorker())
+    {
+        flushScheduled[socket->idgs] = true;
+        if(workerQueue.call_in(socket->coalesceDelay, this, &GS1500MInterface::flushDeadline, socket->idgs) == 0)
+        {
+            flushScheduled[socket->idgs] = false;
+            gsat.flush(socket->idgs, GS1500M_SEND_TIMEOUT);
+        }
     }
 
     return size;
 }
 
+nsapi_size_or_error_t GS1500MInterface::send_stream(nsapi_socket_t handle, mbed::Callback<size_t(char*, size_t)> producer)
+{
+    struct GS1500M_socket* socket = (struct GS1500M_socket*)handle;
+    if(!socket || !producer)
+    {
+        return NSAPI_ERROR_PARAMETER;
+    }
+    if(!socket->connected)
+    {
+        return NSAPI_ERROR_NO_CONNECTION;
+    }
+
+    uint32_t sent = 0;
+    if(!gsat.sendStream(socket->idgs, producer, GS1500M_SEND_TIMEOUT, &sent))
+    {
+        return recordError(socket, socket_error(socket->idgs));
+    }
+    return sent;
+}
+
+int GS1500MInterface::poll(GS1500MPollFd* fds, unsigned count, uint32_t timeoutMs)
+{
+    uint32_t mask = 0;
+    for(unsigned i = 0; i < count; i++)
+    {
+        struct GS1500M_socket* socket = (struct GS1500M_socket*)fds[i].handle;
+        if(!socket)
+        {
+            return NSAPI_ERROR_PARAMETER;
+        }
+        if(socket->connected)
+        {
+            mask |= 1u << socket->idgs;
+        }
+    }
+
+    uint64_t start = rtos::Kernel::get_ms_count();
+    while(true)
+    {
+        // taken before looking, so whatever happens meanwhile ends the wait
+        uint32_t seen = gsat.readyCount(mask);
+        int ready = 0;
+        for(unsigned i = 0; i < count; i++)
+        {
+            fds[i].revents = pollEvents(fds[i]);
+            ready += (fds[i].revents != 0);
+        }
+
+        uint32_t elapsed = rtos::Kernel::get_ms_count() - start;
+        if(ready > 0 || elapsed >= timeoutMs)
+        {
+            return ready;
+        }
+        if(!gsat.waitReady(mask, seen, timeoutMs - elapsed))
+        {
+            return 0;
+        }
+    }
+}
+
+int GS1500MInterface::pollEvents(const GS1500MPollFd& fd)
+{
+    struct GS1500M_socket* socket = (struct GS1500M_socket*)fd.handle;
+    int revents = 0;
+    if(!gsat.isLinkUp())
+    {
+        revents |= GS1500M_POLLERR;
+    }
+    if(!socket->connected)
+    {
+        // no CID yet, idgs would be someone else's
+        return revents | GS1500M_POLLHUP;
+    }
+    if(gsat.hasData(socket->idgs))
+    {
+        revents |= fd.events & GS1500M_POLLIN;
+    }
+    if(!gsat.isSocketOpen(socket->idgs))
+    {
+        revents |= GS1500M_POLLHUP;
+    }
+    else if(!asyncFull(socket))
+    {
+        revents |= fd.events & GS1500M_POLLOUT;
+    }
+    return revents;
+}
+
+bool GS1500MInterface::asyncFull(struct GS1500M_socket* socket)
+{
+    asyncMutex.lock();
+    bool full = socket->async.done
+                && (socket->asyncQueued + socket->asyncBusy >= GS1500M_ASYNC_SEND_DEPTH);
+    asyncMutex.unlock();
+    return full;
+}
+
 int GS1500MInterface::socket_recv(void* handle, void* data, unsigned size)
 {
     struct GS1500M_socket* socket = (struct GS1500M_socket*)handle;
-    gsat.setTimeout(GS1500M_RECV_TIMEOUT);
 
-    int32_t recv = gsat.recv(socket->idgs, data, size);
+    if(!socket->connected && !socket->bound)
+    {
+        return NSAPI_ERROR_NO_CONNECTION;
+    }
+
+    if(gsat.hasPending(socket->idgs) && !socket->async.done)
+    {
+        // caller waits for an answer, do not hold back its request
+        gsat.flush(socket->idgs, GS1500M_SEND_TIMEOUT);
+    }
+
+    // never sleeps, sigio announces new data
+    int32_t recv = gsat.recv(socket->idgs, data, size, 0);
     if(recv < 0)
     {
         return NSAPI_ERROR_WOULD_BLOCK;
@@ -327,6 +968,476 @@ void GS1500MInterface::socket_attach(void* handle, void (*callback)(void*), void
     _cbs[socket->id].data = data;
 }
 
+nsapi_error_t GS1500MInterface::applySocketOptions(struct GS1500M_socket* socket)
+{
+    nsapi_error_t err = NSAPI_ERROR_OK;
+    if(socket->keepalive >= 0 && err == NSAPI_ERROR_OK)
+    {
+        err = setModuleOption(socket, GS1500M_SOL_SOCKET, GS1500M_SO_KEEPALIVE, socket->keepalive);
+    }
+    if(socket->keepIdleS >= 0 && err == NSAPI_ERROR_OK)
+    {
+        err = setModuleOption(socket, GS1500M_IPPROTO_TCP, GS1500M_TCP_KEEPALIVE, socket->keepIdleS);
+    }
+    if(socket->sndbuf >= 0 && err == NSAPI_ERROR_OK)
+    {
+        err = setModuleOption(socket, GS1500M_SOL_SOCKET, GS1500M_SO_SNDBUF, socket->sndbuf);
+    }
+    if(socket->rcvbuf >= 0 && err == NSAPI_ERROR_OK)
+    {
+        err = setModuleOption(socket, GS1500M_SOL_SOCKET, GS1500M_SO_RCVBUF, socket->rcvbuf);
+    }
+    if(socket->nodelay >= 0 && err == NSAPI_ERROR_OK)
+    {
+        err = setModuleOption(socket, GS1500M_IPPROTO_TCP, GS1500M_TCP_NODELAY, socket->nodelay);
+    }
+    gsat.setPriority(socket->idgs, socket->priority);
+    if(socket->coalesce && err == NSAPI_ERROR_OK)
+    {
+        // enabling never sends anything
+        gsat.setCoalescing(socket->idgs, true, GS1500M_SEND_TIMEOUT);
+    }
+    return err;
+}
+
+nsapi_error_t GS1500MInterface::setModuleOption(struct GS1500M_socket* socket, int type, int param, int value)
+{
+    if(!socket->connected)
+    {
+        // remembered and applied by applySocketOptions() after connect
+        return NSAPI_ERROR_OK;
+    }
+    return gsat.setSocketOption(socket->idgs, type, param, value, GS1500M_MISC_TIMEOUT)
+        ? NSAPI_ERROR_OK : recordError(socket, socket_error(socket->idgs));
+}
+
+nsapi_error_t GS1500MInterface::setsockopt(nsapi_socket_t handle, int level, int optname, const void* optval, unsigned optlen)
+{
+    struct GS1500M_socket* socket = (struct GS1500M_socket*)handle;
+    if(level == NSAPI_SOCKET)
+    {
+        if(!optval || optlen != sizeof(int) || *(const int*)optval < 0)
+        {
+            return NSAPI_ERROR_PARAMETER;
+        }
+        int value = *(const int*)optval;
+
+        switch(optname)
+        {
+            case NSAPI_KEEPALIVE:
+                socket->keepalive = value ? 1 : 0;
+                return setModuleOption(socket, GS1500M_SOL_SOCKET, GS1500M_SO_KEEPALIVE, socket->keepalive);
+
+            case NSAPI_KEEPIDLE:
+                // ms in NSAPI, module counts seconds
+                socket->keepIdleS = (value + 999) / 1000;
+                return setModuleOption(socket, GS1500M_IPPROTO_TCP, GS1500M_TCP_KEEPALIVE, socket->keepIdleS);
+
+            case NSAPI_SNDBUF:
+                socket->sndbuf = value;
+                return setModuleOption(socket, GS1500M_SOL_SOCKET, GS1500M_SO_SNDBUF, value);
+
+            case NSAPI_RCVBUF:
+                socket->rcvbuf = value;
+                return setModuleOption(socket, GS1500M_SOL_SOCKET, GS1500M_SO_RCVBUF, value);
+
+            default:
+                return NSAPI_ERROR_UNSUPPORTED;
+        }
+    }
+
+    if(level != GS1500M_SOCKET_LEVEL)
+    {
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+
+    switch(optname)
+    {
+        case GS1500M_COALESCE:
+            if(!optval || optlen != sizeof(int) || socket->proto != NSAPI_TCP)
+            {
+                return NSAPI_ERROR_PARAMETER;
+            }
+            socket->coalesce = (*(const int*)optval != 0);
+            if(!socket->connected)
+            {
+                // CID only known after connect, applySocketOptions() enables it
+                return NSAPI_ERROR_OK;
+            }
+            return gsat.setCoalescing(socket->idgs, socket->coalesce, GS1500M_SEND_TIMEOUT) ? NSAPI_ERROR_OK : socket_error(socket->idgs);
+
+        case GS1500M_COALESCE_DELAY:
+            if(!optval || optlen != sizeof(int) || *(const int*)optval < 0)
+            {
+                return NSAPI_ERROR_PARAMETER;
+            }
+            socket->coalesceDelay = *(const int*)optval;
+            return NSAPI_ERROR_OK;
+
+        case GS1500M_FLUSH:
+            return gsat.flush(socket->idgs, GS1500M_SEND_TIMEOUT) ? NSAPI_ERROR_OK : socket_error(socket->idgs);
+
+        case GS1500M_PRIORITY:
+            if(!optval || optlen != sizeof(int)
+               || *(const int*)optval < TX_PRIORITY_REALTIME
+               || *(const int*)optval >= TX_PRIORITY_COUNT)
+            {
+                return NSAPI_ERROR_PARAMETER;
+            }
+            socket->priority = static_cast<TxPriority>(*(const int*)optval);
+            if(socket->connected)
+            {
+                gsat.setPriority(socket->idgs, socket->priority);
+            }
+            return NSAPI_ERROR_OK;
+
+        case GS1500M_TLS:
+            // NUL terminator optional, empty name turns TLS off
+            if(socket->proto != NSAPI_TCP || socket->connected
+               || (optlen && !optval) || optlen > GS1500M_CERT_NAME_SIZE + 1)
+            {
+                return NSAPI_ERROR_PARAMETER;
+            }
+            memset(socket->tlsCa, 0, sizeof(socket->tlsCa));
+            if(optlen)
+            {
+                memcpy(socket->tlsCa, optval, optlen);
+            }
+            if(socket->tlsCa[GS1500M_CERT_NAME_SIZE] != '\0')
+            {
+                socket->tlsCa[0] = '\0';
+                return NSAPI_ERROR_PARAMETER;
+            }
+            return NSAPI_ERROR_OK;
+
+        case GS1500M_NODELAY:
+            if(!optval || optlen != sizeof(int) || socket->proto != NSAPI_TCP)
+            {
+                return NSAPI_ERROR_PARAMETER;
+            }
+            socket->nodelay = *(const int*)optval ? 1 : 0;
+            return setModuleOption(socket, GS1500M_IPPROTO_TCP, GS1500M_TCP_NODELAY, socket->nodelay);
+
+        case GS1500M_POOL:
+            // module TLS sessions are not pooled
+            if(!optval || optlen != sizeof(int) || socket->proto != NSAPI_TCP
+               || socket->connected || socket->tlsCa[0])
+            {
+                return NSAPI_ERROR_PARAMETER;
+            }
+            socket->pooled = *(const int*)optval != 0;
+            return NSAPI_ERROR_OK;
+
+        case GS1500M_ASYNC:
+            if(!optval || optlen != sizeof(GS1500MAsyncSend))
+            {
+                return NSAPI_ERROR_PARAMETER;
+            }
+            return setAsync(socket, (const GS1500MAsyncSend*)optval);
+
+        case GS1500M_MODULE_OPTION:
+        {
+            if(!optval || optlen != sizeof(GS1500MModuleOption))
+            {
+                return NSAPI_ERROR_PARAMETER;
+            }
+            if(!socket->connected)
+            {
+                return NSAPI_ERROR_NO_CONNECTION;
+            }
+            const GS1500MModuleOption* option = (const GS1500MModuleOption*)optval;
+            return setModuleOption(socket, option->type, option->param, option->value);
+        }
+
+        default:
+            return NSAPI_ERROR_UNSUPPORTED;
+    }
+}
+
+
+nsapi_error_t GS1500MInterface::getsockopt(nsapi_socket_t handle, int level, int optname, void* optval, unsigned* optlen)
+{
+    struct GS1500M_socket* socket = (struct GS1500M_socket*)handle;
+    if(!optval || !optlen)
+    {
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    if(level == GS1500M_SOCKET_LEVEL && optname == GS1500M_SOCKET_STATS)
+    {
+        if(*optlen < sizeof(GS1500MSocketStats))
+        {
+            return NSAPI_ERROR_PARAMETER;
+        }
+        GS1500MSocketStats* stats = (GS1500MSocketStats*)optval;
+        if(socket->connected)
+        {
+            gsat.getSocketStats(socket->idgs, *stats);
+        }
+        else
+        {
+            memset(stats, 0, sizeof(*stats));
+        }
+        stats->lastError = socket->lastError;
+        *optlen = sizeof(GS1500MSocketStats);
+        return NSAPI_ERROR_OK;
+    }
+
+    if(level == GS1500M_SOCKET_LEVEL && optname == GS1500M_SOCKET_HANDLE)
+    {
+        if(*optlen < sizeof(nsapi_socket_t))
+        {
+            return NSAPI_ERROR_PARAMETER;
+        }
+        *(nsapi_socket_t*)optval = handle;
+        *optlen = sizeof(nsapi_socket_t);
+        return NSAPI_ERROR_OK;
+    }
+
+    if(*optlen < sizeof(int))
+    {
+        return NSAPI_ERROR_PARAMETER;
+    }
+
+    if(level == GS1500M_SOCKET_LEVEL && optname == GS1500M_ASYNC)
+    {
+        asyncMutex.lock();
+        *(int*)optval = socket->asyncQueued + socket->asyncBusy;
+        asyncMutex.unlock();
+        *optlen = sizeof(int);
+        return NSAPI_ERROR_OK;
+    }
+
+    if(level == GS1500M_SOCKET_LEVEL && optname == GS1500M_POOL)
+    {
+        *(int*)optval = socket->reused;
+        *optlen = sizeof(int);
+        return NSAPI_ERROR_OK;
+    }
+
+    if(level == GS1500M_SOCKET_LEVEL && optname == GS1500M_SOCKET_ID)
+    {
+        *(int*)optval = socket->connected ? socket->idgs : -1;
+        *optlen = sizeof(int);
+        return NSAPI_ERROR_OK;
+    }
+
+    if(level == NSAPI_SOCKET)
+    {
+        // values set through setsockopt(), -1 for module default
+        switch(optname)
+        {
+            case NSAPI_KEEPALIVE:
+                *(int*)optval = socket->keepalive;
+                break;
+
+            case NSAPI_KEEPIDLE:
+                *(int*)optval = (socket->keepIdleS < 0) ? -1 : socket->keepIdleS * 1000;
+                break;
+
+            case NSAPI_SNDBUF:
+                *(int*)optval = socket->sndbuf;
+                break;
+
+            case NSAPI_RCVBUF:
+                *(int*)optval = socket->rcvbuf;
+                break;
+
+            default:
+                return NSAPI_ERROR_UNSUPPORTED;
+        }
+        *optlen = sizeof(int);
+        return NSAPI_ERROR_OK;
+    }
+
+    if(level != GS1500M_SOCKET_LEVEL)
+    {
+        return NSAPI_ERROR_UNSUPPORTED;
+    }
+
+    switch(optname)
+    {
+        case GS1500M_COALESCE:
+            *(int*)optval = socket->coalesce ? 1 : 0;
+            break;
+
+        case GS1500M_COALESCE_DELAY:
+            *(int*)optval = socket->coalesceDelay;
+            break;
+
+        case GS1500M_PRIORITY:
+            *(int*)optval = socket->priority;
+            break;
+
+        case GS1500M_TLS:
+            *(int*)optval = (socket->connected && gsat.isTls(socket->idgs)) ? 1 : 0;
+            break;
+
+        case GS1500M_NODELAY:
+            *(int*)optval = socket->nodelay;
+            break;
+
+        default:
+            return NSAPI_ERROR_UNSUPPORTED;
+    }
+
+    *optlen = sizeof(int);
+    return NSAPI_ERROR_OK;
+}
+
+void GS1500MInterface::flushDeadline(int idgs)
+{
+    flushScheduled[idgs] = false;
+    gsat.flush(idgs, GS1500M_SEND_TIMEOUT);
+}
+
+nsapi_error_t GS1500MInterface::setAsync(struct GS1500M_socket* socket, const GS1500MAsyncSend* config)
+{
+    asyncMutex.lock();
+    if(socket->asyncQueued || socket->asyncBusy)
+    {
+        // outstanding sends complete through the callback they were queued with
+        asyncMutex.unlock();
+        return NSAPI_ERROR_BUSY;
+    }
+    socket->async = *config;
+    asyncMutex.unlock();
+    return NSAPI_ERROR_OK;
+}
+
+void GS1500MInterface::dropAsync(struct GS1500M_socket* socket)
+{
+    asyncMutex.lock();
+    int dropped = socket->asyncQueued;
+    while(socket->asyncQueued)
+    {
+        delete[] socket->asyncData[socket->asyncHead];
+        socket->asyncHead = (socket->asyncHead + 1) % GS1500M_ASYNC_SEND_DEPTH;
+        socket->asyncQueued--;
+    }
+    _sockets[socket->id] = nullptr;
+    asyncGeneration[socket->id]++;
+    asyncMutex.unlock();
+
+    // a send the worker already took is still going out on idgs; the CID
+    // must not be closed and handed to another connection under it
+    while(true)
+    {
+        asyncMutex.lock();
+        bool busy = socket->asyncBusy;
+        if(busy)
+        {
+            asyncIdle.clear(1u << socket->id);
+        }
+        asyncMutex.unlock();
+        if(!busy)
+        {
+            break;
+        }
+        asyncIdle.wait_any(1u << socket->id);
+    }
+
+    // every queued send gets its completion
+    for(int i = 0; i < dropped; i++)
+    {
+        if(socket->async.queue)
+        {
+            socket->async.queue->call(socket->async.done, NSAPI_ERROR_NO_SOCKET);
+        }
+        else
+        {
+            socket->async.done(NSAPI_ERROR_NO_SOCKET);
+        }
+    }
+}
+
+void GS1500MInterface::drainAsync(int id, uint32_t generation)
+{
+    asyncMutex.lock();
+    struct GS1500M_socket* socket = _sockets[id];
+    if(!socket || asyncGeneration[id] != generation || !socket->asyncQueued)
+    {
+        asyncMutex.unlock();
+        return;
+    }
+    char* data = socket->asyncData[socket->asyncHead];
+    unsigned size = socket->asyncSize[socket->asyncHead];
+    socket->asyncHead = (socket->asyncHead + 1) % GS1500M_ASYNC_SEND_DEPTH;
+    socket->asyncQueued--;
+    socket->asyncBusy = true;
+    int idgs = socket->idgs;
+    int coalesceDelay = socket->coalesceDelay;
+    GS1500MAsyncSend async = socket->async;
+    asyncMutex.unlock();
+
+    // socket_close() waits for asyncBusy to clear, so idgs stays this socket's
+    nsapi_size_or_error_t result = size;
+    if(gsat.send(idgs, data, size, GS1500M_SEND_TIMEOUT) == 0)
+    {
+        result = socket_error(idgs);
+    }
+    else if(gsat.hasPending(idgs) && !flushScheduled[idgs])
+    {
+        // recv() does not flush in async mode, deadline alone pushes merged data out
+        flushScheduled[idgs] = true;
+        if(workerQueue.call_in(coalesceDelay, this, &GS1500MInterface::flushDeadline, idgs) == 0)
+        {
+            flushScheduled[idgs] = false;
+            gsat.flush(idgs, GS1500M_SEND_TIMEOUT);
+        }
+    }
+    delete[] data;
+
+    asyncMutex.lock();
+    socket->asyncBusy = false;
+    if(result < 0 && asyncGeneration[id] == generation)
+    {
+        recordError(socket, result);
+    }
+    asyncIdle.set(1u << id);
+    asyncMutex.unlock();
+
+    if(async.queue)
+    {
+        async.queue->call(async.done, result);
+    }
+    else
+    {
+        async.done(result);
+    }
+
+    // room for another send
+    gsat.notifyReady(idgs);
+    if(_cbs[id].callback)
+    {
+        _cbs[id].callback(_cbs[id].data);
+    }
+}
+
+int GS1500MInterface::socket_error(int idgs)
+{
+    if(!gsat.isLinkUp())
+    {
+        return NSAPI_ERROR_CONNECTION_LOST;
+    }
+
+    if(!gsat.isSocketOpen(idgs))
+    {
+        return NSAPI_ERROR_NO_CONNECTION;
+    }
+
+    return NSAPI_ERROR_DEVICE_ERROR;
+}
+
+void GS1500MInterface::linkEvent(bool up)
+{
+    if(!up && connectPhase == GS1500M_CONNECT_PHASE_DONE)
+    {
+        connectPhase = GS1500M_CONNECT_PHASE_IDLE;
+        setStatus(NSAPI_STATUS_DISCONNECTED);
+    }
+}
+
 void GS1500MInterface::event()
 {
     for(int i = 0; i < GS1500M_SOCKET_COUNT; i++)
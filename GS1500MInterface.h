@@ -30,10 +30,106 @@
 #include "mbed.h"
 #include "GS1500M.h"
 
+// Driver specific socket options, used with setsockopt()/getsockopt()
+// at level GS1500M_SOCKET_LEVEL
+const int GS1500M_SOCKET_LEVEL = 0x1500;
+
+enum GS1500MSocketOption
+{
+    GS1500M_COALESCE,       // int, merge small sends into full bulk frames
+    GS1500M_COALESCE_DELAY, // int, ms after which merged data is sent anyway
+    GS1500M_FLUSH,          // no value, send merged data now
+    GS1500M_PRIORITY,       // int, TxPriority class used for socket data
+    GS1500M_TLS,            // char[], CA certificate name; set before connect to run TLS on the module
+                            // getsockopt() gives int, 1 when TLS session is up
+    GS1500M_NODELAY,        // int, 1 disables Nagle on the module
+    GS1500M_MODULE_OPTION,  // GS1500MModuleOption, raw AT+SETSOCKOPT on a connected socket, set only
+    GS1500M_SOCKET_STATS,   // GS1500MSocketStats, get only
+    GS1500M_SOCKET_ID,      // int, module CID, get only, -1 until connected
+    GS1500M_ASYNC,          // GS1500MAsyncSend, queue sends and complete them on the worker thread
+                            // getsockopt() gives int, number of sends not yet completed
+    GS1500M_POOL,           // int, 1 before connect: take TCP connection from keep-warm pool, park it on close
+                            // getsockopt() gives int, 1 when connect reused a pooled connection
+    GS1500M_SOCKET_HANDLE   // nsapi_socket_t, driver handle for poll() and send_stream(), get only
+};
+
+// Asynchronous send mode: send() copies the data, returns at once and
+// NSAPI_ERROR_WOULD_BLOCK only when async-send-depth sends are outstanding.
+// done gets bytes sent or error per send, posted to queue or, when queue is
+// null, called on the worker thread. A null done switches back to blocking sends.
+struct GS1500MAsyncSend
+{
+    events::EventQueue* queue;
+    mbed::Callback<void(nsapi_size_or_error_t)> done;
+};
+
+// poll() interest and result bits
+enum GS1500MPollEvent
+{
+    GS1500M_POLLIN  = 0x1,  // data to recv()
+    GS1500M_POLLOUT = 0x2,  // send() would not block
+    GS1500M_POLLERR = 0x4,  // link lost, always reported
+    GS1500M_POLLHUP = 0x8   // closed by peer, recv() gives 0 once data is read; always reported
+};
+
+struct GS1500MPollFd
+{
+    nsapi_socket_t handle; // see GS1500M_SOCKET_HANDLE
+    int events;  // GS1500MPollEvent bits of interest
+    int revents; // bits that are ready, set by poll()
+};
+
+struct GS1500MModuleOption
+{
+    int type;   // e.g. GS1500M_SOL_SOCKET, GS1500M_IPPROTO_TCP
+    int param;
+    int value;
+};
+
+// longest certificate name accepted by the module
+const unsigned GS1500M_CERT_NAME_SIZE = 32;
+
+enum GS1500MConnectPath
+{
+    GS1500M_CONNECT_PATH_NONE, // no connect attempted or last attempt failed
+    GS1500M_CONNECT_PATH_FULL, // reset, provisioning, DHCP and association
+    GS1500M_CONNECT_PATH_FAST  // healthy module, stored profile reused
+};
+
+enum GS1500MConnectPhase
+{
+    GS1500M_CONNECT_PHASE_IDLE,
+    GS1500M_CONNECT_PHASE_PROBE,
+    GS1500M_CONNECT_PHASE_STARTUP,
+    GS1500M_CONNECT_PHASE_DHCP,
+    GS1500M_CONNECT_PHASE_ASSOCIATE,
+    GS1500M_CONNECT_PHASE_ADDRESS,
+    GS1500M_CONNECT_PHASE_DONE,
+    GS1500M_CONNECT_PHASE_FAILED
+};
+
+struct GS1500MConnectStats
+{
+    GS1500MConnectPath path;
+    bool pinned; // associated on known channel/BSSID without full scan
+    uint32_t probeMs;
+    uint32_t startupMs;
+    uint32_t dhcpMs;
+    uint32_t associateMs;
+    uint32_t ipMs;
+    uint32_t totalMs;
+};
+
+struct GS1500M_socket;
+class GS1500MMultiInterface;
+
 class GS1500MInterface : public NetworkStack, public WiFiInterface
 {
 public:
-    GS1500MInterface(PinName tx, PinName rx, int baud);
+    // reset and powerDown pins of this module, see GS1500M
+    GS1500MInterface(PinName tx, PinName rx, int baud, PinName reset = NC, PinName powerDown = NC);
+    // e.g. SpiTransport for boards routing the module's SPI host interface
+    explicit GS1500MInterface(Transport& transport, PinName reset = NC, PinName powerDown = NC);
     virtual ~GS1500MInterface() = default;
 
     // Interface implementations
@@ -41,6 +137,8 @@ public:
                                 const char *pass,
                                 nsapi_security_t security);
     virtual int set_channel(uint8_t channel);
+    // pin association to one access point, null clears
+    int set_bssid(const uint8_t* bssid);
 
     virtual int connect(const char* ssid,
                         const char* pass,
@@ -48,8 +146,40 @@ public:
                         uint8_t channel);
 
     virtual int connect();
+    // needs powerDown pin; connect() again after power up
+    int set_power_down(bool down);
     virtual int disconnect();
 
+    // When enabled, connect() first probes the module with AT and, if it kept
+    // its configuration, skips reset/provisioning and reuses stored profile.
+    void set_fast_reconnect(bool enabled);
+    const GS1500MConnectStats& get_connect_stats() const;
+
+    // In non-blocking mode connect() returns at once and bring-up runs on the
+    // driver worker thread; progress is reported through the status callback.
+    virtual nsapi_error_t set_blocking(bool blocking);
+    virtual void attach(mbed::Callback<void(nsapi_event_t, intptr_t)> status_cb);
+    virtual nsapi_connection_status_t get_connection_status() const;
+    GS1500MConnectPhase get_connect_phase() const;
+
+    // Power profile may be switched at any time, also while associated.
+    int set_power_profile(GS1500MPowerProfile profile);
+    GS1500MPowerProfile get_power_profile();
+    // Measurement mode records time from each completed send to the first
+    // data received afterwards, accumulated per active power profile.
+    void set_latency_measurement(bool enabled);
+    const GS1500MWakeLatency& get_wake_latency(GS1500MPowerProfile profile);
+
+    // response time estimation behind the deadlines of a command class
+    RttEstimate get_rtt_estimate(GS1500MRttClass rttClass);
+    // UART queueing delay observed per priority class
+    TxQueueStats get_tx_queue_stats(TxPriority priority);
+    void get_usage(GS1500MUsage& usage);
+    // sockets currently open on this module
+    int get_socket_count();
+    // returns result of the last connect or NSAPI_ERROR_IN_PROGRESS on timeout
+    int wait_connected(uint32_t timeoutMs = osWaitForever);
+
     virtual const char* get_ip_address();
     virtual const char* get_mac_address();
     virtual const char* get_gateway();
@@ -58,10 +188,41 @@ public:
     virtual int8_t get_rssi();
 
     virtual int scan(WiFiAccessPoint* res, unsigned count);
+    // onAp is called for every access point as soon as it is parsed
+    int scan(WiFiAccessPoint* res, unsigned count, mbed::Callback<void(const nsapi_wifi_ap_t&)> onAp);
+    // access points remembered from previous scans, no UART traffic
+    unsigned get_scan_cache(GS1500MScanEntry* res, unsigned count);
+
+    // Load DER certificate into module RAM to be referenced by GS1500M_TLS
+    nsapi_error_t add_certificate(const char* name, const void* der, unsigned length);
+    nsapi_error_t remove_certificate(const char* name);
+
+    // HTTP client running on the module, see GS1500M::httpOpen(). id is a
+    // module CID, http_request() returns the status code or negative error
+    // and http_read() the body like socket_recv().
+    nsapi_error_t http_configure(GS1500MHttpParam param, const char* value);
+    nsapi_error_t http_open(const char* host, int port, bool tls, int& id);
+    int http_request(int id, GS1500MHttpMethod method, const char* path, const void* body, unsigned length);
+    int http_read(int id, void* data, unsigned size);
+    nsapi_error_t http_close(int id);
+
+    // Upload without staging the whole payload: producer fills the frame
+    // buffer it is given and returns the bytes written, 0 at the end. handle
+    // as for poll() (GS1500M_SOCKET_HANDLE). Returns bytes sent or negative error.
+    nsapi_size_or_error_t send_stream(nsapi_socket_t handle, mbed::Callback<size_t(char*, size_t)> producer);
+
+    // Waits until at least one of the sockets is ready or timeoutMs passed.
+    // Returns the number of entries with revents set, 0 on timeout. A socket
+    // that is not connected reports GS1500M_POLLHUP. Several threads may
+    // poll at once.
+    int poll(GS1500MPollFd* fds, unsigned count, uint32_t timeoutMs);
 
     // override NetworkStack to use GS1500M DNS
     nsapi_error_t gethostbyname(const char *name, SocketAddress *address, nsapi_version_t version = NSAPI_UNSPEC);
 
+    virtual nsapi_error_t setsockopt(nsapi_socket_t handle, int level, int optname, const void* optval, unsigned optlen);
+    virtual nsapi_error_t getsockopt(nsapi_socket_t handle, int level, int optname, void* optval, unsigned* optlen);
+
     // make non-copyable C++11 style
     GS1500MInterface(const GS1500MInterface& other) = delete;
     GS1500MInterface& operator=(const GS1500MInterface&) = delete;
@@ -88,14 +249,54 @@ protected:
     }
 
 private:
+    friend class GS1500MMultiInterface;
+
+    GS1500MInterface(Transport* transport, bool owned, PinName reset, PinName powerDown);
+
     GS1500M gsat;
     bool _ids[GS1500M_SOCKET_COUNT];
 
     char ap_ssid[33]; /* 32 is what 802.11 defines as longest possible name; +1 for the \0 */
     nsapi_security_t ap_sec;
     uint8_t ap_ch;
+    uint8_t ap_bssid[6];
+    bool ap_bssid_set;
     char ap_pass[64]; /* The longest allowed passphrase */
 
+    bool fastReconnect;
+    bool blocking;
+    bool connectFast;
+    volatile int connectResult;
+    volatile GS1500MConnectPhase connectPhase;
+    volatile nsapi_connection_status_t connectionStatus;
+    GS1500MConnectStats connectStats;
+    Timer connectTotal;
+    rtos::EventFlags connectFlags;
+    mbed::Callback<void(nsapi_event_t, intptr_t)> statusCallback;
+
+    rtos::Thread workerThread;
+    events::EventQueue workerQueue;
+    bool workerStarted;
+    volatile bool flushScheduled[GS1500M_SOCKET_COUNT];
+
+    void beginConnect();
+    bool connectStep();
+    void connectAsyncStep();
+    void failPhase(int error);
+    void finishConnect(int error);
+    void setPhase(GS1500MConnectPhase phase);
+    void setStatus(nsapi_connection_status_t status);
+    bool startWorker();
+    int socket_error(int idgs);
+    nsapi_error_t applySocketOptions(struct GS1500M_socket* socket);
+    nsapi_error_t setModuleOption(struct GS1500M_socket* socket, int type, int param, int value);
+    void flushDeadline(int idgs);
+    nsapi_error_t setAsync(struct GS1500M_socket* socket, const GS1500MAsyncSend* config);
+    void dropAsync(struct GS1500M_socket* socket);
+    void drainAsync(int id, uint32_t generation);
+    bool asyncFull(struct GS1500M_socket* socket);
+    int pollEvents(const GS1500MPollFd& fd);
+    void linkEvent(bool up);
     void event();
 
     struct
@@ -103,4 +304,11 @@ private:
         void (*callback)(void*);
         void* data;
     } _cbs[GS1500M_SOCKET_COUNT];
+    // open sockets by id, for the worker thread; pending async sends are guarded by asyncMutex
+    struct GS1500M_socket* _sockets[GS1500M_SOCKET_COUNT];
+    // bumped on close so a send completing afterwards leaves the next socket on the id alone
+    uint32_t asyncGeneration[GS1500M_SOCKET_COUNT];
+    PlatformMutex asyncMutex;
+    // bit per id, set when the worker finished the send it had taken
+    rtos::EventFlags asyncIdle;
 };
@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2018 Slashdev SDG UG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GS1500MMultiInterface.h"
+
+struct GS1500M_multi_socket
+{
+    GS1500MInterface* module;
+    void* handle;
+};
+
+GS1500MMultiInterface::GS1500MMultiInterface()
+    : moduleCount(0)
+{
+    memset(modules, 0, sizeof(modules));
+}
+
+nsapi_error_t GS1500MMultiInterface::add(GS1500MInterface& module)
+{
+    if(moduleCount >= GS1500M_MAX_MODULES)
+    {
+        return NSAPI_ERROR_NO_MEMORY;
+    }
+
+    modules[moduleCount++] = &module;
+    return NSAPI_ERROR_OK;
+}
+
+int GS1500MMultiInterface::get_module_count()
+{
+    return moduleCount;
+}
+
+nsapi_error_t GS1500MMultiInterface::connect()
+{
+    nsapi_error_t ret = NSAPI_ERROR_OK;
+    for(int i = 0; i < moduleCount; i++)
+    {
+        nsapi_error_t err = modules[i]->connect();
+        if(ret == NSAPI_ERROR_OK)
+        {
+            ret = err;
+        }
+    }
+    return (moduleCount == 0) ? NSAPI_ERROR_NO_CONNECTION : ret;
+}
+
+nsapi_error_t GS1500MMultiInterface::disconnect()
+{
+    nsapi_error_t ret = NSAPI_ERROR_OK;
+    for(int i = 0; i < moduleCount; i++)
+    {
+        nsapi_error_t err = modules[i]->disconnect();
+        if(ret == NSAPI_ERROR_OK)
+        {
+            ret = err;
+        }
+    }
+    return ret;
+}
+
+GS1500MInterface* GS1500MMultiInterface::firstConnected()
+{
+    for(int i = 0; i < moduleCount; i++)
+    {
+        if(modules[i]->get_connection_status() == NSAPI_STATUS_GLOBAL_UP)
+        {
+            return modules[i];
+        }
+    }
+    return nullptr;
+}
+
+GS1500MInterface* GS1500MMultiInterface::leastLoaded()
+{
+    GS1500MInterface* best = nullptr;
+    int bestCount = GS1500M_SOCKET_COUNT;
+    bool bestUp = false;
+    for(int i = 0; i < moduleCount; i++)
+    {
+        int count = modules[i]->get_socket_count();
+        bool up = (modules[i]->get_connection_status() == NSAPI_STATUS_GLOBAL_UP);
+        if(count >= GS1500M_SOCKET_COUNT)
+        {
+            continue;
+        }
+        // a module without link only takes sockets when none has one
+        if(!best || (up && !bestUp) || (up == bestUp && count < bestCount))
+        {
+            best = modules[i];
+            bestCount = count;
+            bestUp = up;
+        }
+    }
+    return best;
+}
+
+const char* GS1500MMultiInterface::get_ip_address()
+{
+    GS1500MInterface* module = firstConnected();
+    return module ? module->get_ip_address() : nullptr;
+}
+
+nsapi_error_t GS1500MMultiInterface::gethostbyname(const char* name, SocketAddress* address, nsapi_version_t version)
+{
+    GS1500MInterface* module = firstConnected();
+    if(!module)
+    {
+        return NSAPI_ERROR_NO_CONNECTION;
+    }
+    return module->gethostbyname(name, address, version);
+}
+
+nsapi_error_t GS1500MMultiInterface::setsockopt(nsapi_socket_t handle, int level, int optname, const void* optval, unsigned optlen)
+{
+    struct GS1500M_multi_socket* socket = (struct GS1500M_multi_socket*)handle;
+    return socket->module->setsockopt(socket->handle, level, optname, optval, optlen);
+}
+
+nsapi_error_t GS1500MMultiInterface::getsockopt(nsapi_socket_t handle, int level, int optname, void* optval, unsigned* optlen)
+{
+    struct GS1500M_multi_socket* socket = (struct GS1500M_multi_socket*)handle;
+    return socket->module->getsockopt(socket->handle, level, optname, optval, optlen);
+}
+
+int GS1500MMultiInterface::socket_open(void** handle, nsapi_protocol_t proto)
+{
+    GS1500MInterface* module = leastLoaded();
+    if(!module)
+    {
+        return NSAPI_ERROR_NO_SOCKET;
+    }
+
+    void* inner;
+    int ret = module->socket_open(&inner, proto);
+    if(ret != 0)
+    {
+        return ret;
+    }
+
+    struct GS1500M_multi_socket* socket = new struct GS1500M_multi_socket;
+    socket->module = module;
+    socket->handle = inner;
+    *handle = socket;
+    return 0;
+}
+
+int GS1500MMultiInterface::socket_close(void* handle)
+{
+    struct GS1500M_multi_socket* socket = (struct GS1500M_multi_socket*)handle;
+    int ret = socket->module->socket_close(socket->handle);
+    delete socket;
+    return ret;
+}
+
+int GS1500MMultiInterface::socket_bind(void* handle, const SocketAddress& address)
+{
+    struct GS1500M_multi_socket* socket = (struct GS1500M_multi_socket*)handle;
+    return socket->module->socket_bind(socket->handle, address);
+}
+
+int GS1500MMultiInterface::socket_listen(void* handle, int backlog)
+{
+    struct GS1500M_multi_socket* socket = (struct GS1500M_multi_socket*)handle;
+    return socket->module->socket_listen(socket->handle, backlog);
+}
+
+int GS1500MMultiInterface::socket_connect(void* handle, const SocketAddress& address)
+{
+    struct GS1500M_multi_socket* socket = (struct GS1500M_multi_socket*)handle;
+    return socket->module->socket_connect(socket->handle, address);
+}
+
+int GS1500MMultiInterface::socket_accept(void* handle, void** client, SocketAddress* address)
+{
+    struct GS1500M_multi_socket* server = (struct GS1500M_multi_socket*)handle;
+
+    // clients arrive on the module the server listens on
+    void* inner;
+    int ret = server->module->socket_accept(server->handle, &inner, address);
+    if(ret != 0)
+    {
+        return ret;
+    }
+
+    struct GS1500M_multi_socket* socket = new struct GS1500M_multi_socket;
+    socket->module = server->module;
+    socket->handle = inner;
+    *client = socket;
+    return 0;
+}
+
+int GS1500MMultiInterface::socket_send(void* handle, const void* data, unsigned size)
+{
+    struct GS1500M_multi_socket* socket = (struct GS1500M_multi_socket*)handle;
+    return socket->module->socket_send(socket->handle, data, size);
+}
+
+int GS1500MMultiInterface::socket_recv(void* handle, void* data, unsigned size)
+{
+    struct GS1500M_multi_socket* socket = (struct GS1500M_multi_socket*)handle;
+    return socket->module->socket_recv(socket->handle, data, size);
+}
+
+int GS1500MMultiInterface::socket_sendto(void* handle, const SocketAddress& address, const void* data, unsigned size)
+{
+    struct GS1500M_multi_socket* socket = (struct GS1500M_multi_socket*)handle;
+    return socket->module->socket_sendto(socket->handle, address, data, size);
+}
+
+int GS1500MMultiInterface::socket_recvfrom(void* handle, SocketAddress* address, void* buffer, unsigned size)
+{
+    struct GS1500M_multi_socket* socket = (struct GS1500M_multi_socket*)handle;
+    return socket->module->socket_recvfrom(socket->handle, address, buffer, size);
+}
+
+void GS1500MMultiInterface::socket_attach(void* handle, void (*callback)(void*), void* data)
+{
+    struct GS1500M_multi_socket* socket = (struct GS1500M_multi_socket*)handle;
+    socket->module->socket_attach(socket->handle, callback, data);
+}
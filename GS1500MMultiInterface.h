@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2018 Slashdev SDG UG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "GS1500MInterface.h"
+
+const int GS1500M_MAX_MODULES = 4;
+
+// Network stack spreading sockets over several modules, each on its own UART
+// and associated on its own. A new socket is placed on the connected module
+// with the fewest open sockets and stays there for its lifetime.
+class GS1500MMultiInterface : public NetworkStack
+{
+public:
+    GS1500MMultiInterface();
+    virtual ~GS1500MMultiInterface() = default;
+
+    // module has to outlive this stack
+    nsapi_error_t add(GS1500MInterface& module);
+    int get_module_count();
+
+    // every module with the credentials set on it, first error is returned
+    nsapi_error_t connect();
+    nsapi_error_t disconnect();
+
+    // of the first connected module
+    virtual const char* get_ip_address();
+    nsapi_error_t gethostbyname(const char* name, SocketAddress* address, nsapi_version_t version = NSAPI_UNSPEC);
+
+    virtual nsapi_error_t setsockopt(nsapi_socket_t handle, int level, int optname, const void* optval, unsigned optlen);
+    virtual nsapi_error_t getsockopt(nsapi_socket_t handle, int level, int optname, void* optval, unsigned* optlen);
+
+    GS1500MMultiInterface(const GS1500MMultiInterface& other) = delete;
+    GS1500MMultiInterface& operator=(const GS1500MMultiInterface&) = delete;
+
+protected:
+    virtual int socket_open(void** handle, nsapi_protocol_t proto);
+    virtual int socket_close(void* handle);
+    virtual int socket_bind(void* handle, const SocketAddress& address);
+    virtual int socket_listen(void* handle, int backlog);
+    virtual int socket_connect(void* handle, const SocketAddress& address);
+    virtual int socket_accept(void* handle, void** socket, SocketAddress* address);
+    virtual int socket_send(void* handle, const void* data, unsigned size);
+    virtual int socket_recv(void* handle, void* data, unsigned size);
+    virtual int socket_sendto(void* handle, const SocketAddress& address, const void* data, unsigned size);
+    virtual int socket_recvfrom(void* handle, SocketAddress* address, void* buffer, unsigned size);
+    virtual void socket_attach(void* handle, void (*callback)(void*), void* data);
+
+private:
+    GS1500MInterface* leastLoaded();
+    GS1500MInterface* firstConnected();
+
+    GS1500MInterface* modules[GS1500M_MAX_MODULES];
+    int moduleCount;
+};
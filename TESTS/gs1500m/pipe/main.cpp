@@ -0,0 +1,506 @@
+/*
+ * Copyright (c) 2018 Slashdev SDG UG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mbed.h"
+#include "greentea-client/test_env.h"
+#include "unity.h"
+#include "utest.h"
+#include "GS1500M.h"
+
+using namespace utest::v1;
+
+// BufferedAT and GS1500M over pairs of PipeTransports, the far end answering
+// like the module would. Runs on any target, no module needed.
+
+static const char ESC = 0x1B;
+static const char DATASENDOK[] = {ESC, 'O', '\0'};
+static const char DATASENDFAIL[] = {ESC, 'F', '\0'};
+static const unsigned BULK_SIZE = 1000; // several times PIPE_FIFO_SIZE
+static const unsigned CERT_SIZE = 300;
+static const int PART_GAP_MS = 20; // long enough for the parser to run dry
+
+// a real AT+WS answer: column header, an SSID with a comma, the count
+static const char SCAN_ANSWER[] =
+    "\r\n"
+    "       BSSID              SSID                     Channel  Type  RSSI Security\r\n"
+    " 00:1d:c9:a0:0b:ff,   Home, Net                 ,  6,  INFRA , -52 , WPA2-PERSONAL\r\n"
+    " 2a:00:11:22:33:44,   Guest                     , 11,  INFRA , -71 , NONE\r\n"
+    " 02:aa:bb:cc:dd:ee,   Office                    ,  1,  INFRA , -80 , WEP\r\n"
+    "No.Of AP Found:3\r\n"
+    "OK\r\n";
+
+class FakeModule
+{
+public:
+    FakeModule()
+        : strayData(false),
+          answer("\r\nOK\r\n"),
+          commandLen(0),
+          bulkExpected(0),
+          bulkReceived(0),
+          bulkCorrupt(false),
+          certExpected(0),
+          certReceived(0),
+          certCorrupt(false)
+    {
+        certName[0] = '\0';
+        end.attachRx(callback(this, &FakeModule::received));
+    }
+
+    void reply(const char* text)
+    {
+        while(*text)
+        {
+            while(!end.writeable())
+            {
+                wait_ms(1);
+            }
+            end.putc(*text++);
+        }
+    }
+
+    PipeTransport end;
+    char certName[16];
+    bool strayData; // data the module did not ask for
+    const char* answer; // to AT+TCERTDEL
+
+private:
+    void command()
+    {
+        unsigned length = 0;
+        char name[sizeof(certName)];
+        unsigned id = 0;
+        if(strcmp(line, "AT") == 0)
+        {
+            reply("\r\nOK\r\n");
+        }
+        else if(strcmp(line, "AT+FAIL") == 0)
+        {
+            reply("\r\nERROR: INVALID INPUT\r\n");
+        }
+        else if(strcmp(line, "AT+SCAN") == 0)
+        {
+            // failure text inside a line is no failure
+            reply("\r\nMY ERROR NET\r\nOK\r\n");
+        }
+        else if(strcmp(line, "AT+FIELDS") == 0)
+        {
+            // fields split across deliveries
+            reply("\r\nIP addr=192.16");
+            wait_ms(PART_GAP_MS);
+            reply("8.1.5 MAC=00:1d:c9:");
+            wait_ms(PART_GAP_MS);
+            reply("a0:0B:ff CID=");
+            wait_ms(PART_GAP_MS);
+            reply("a\r\nOK\r\n");
+        }
+        else if(strcmp(line, "AT+BADIP") == 0)
+        {
+            reply("\r\nIP addr=192.168.300.5\r\nOK\r\n");
+        }
+        else if(strcmp(line, "AT+FRAMES") == 0)
+        {
+            // malformed header, then a payload holding the frame prefix
+            const char frames[] = {ESC, 'Z', '1', 'x', 'y', 'z', 'w',
+                                   ESC, 'Z', '1', '0', '0', '0', '6', 'a', 'b', ESC, 'Z', 'c', 'd', '\0'};
+            reply(frames);
+            reply("\r\nOK\r\n");
+        }
+        else if(strcmp(line, "AT+WS") == 0)
+        {
+            reply(SCAN_ANSWER);
+        }
+        else if(strncmp(line, "AT+TCERTDEL=", 12) == 0)
+        {
+            reply(answer);
+        }
+        else if(sscanf(line, "AT+BULK=%u", &bulkExpected) == 1)
+        {
+            bulkReceived = 0;
+            bulkCorrupt = false;
+            reply("\r\nOK\r\n");
+        }
+        else if(sscanf(line, "AT+TCERTADD=%15[^,],0,%u,1", name, &length) == 2)
+        {
+            if(strcmp(name, "bad") == 0)
+            {
+                reply("\r\nERROR: INVALID INPUT\r\n");
+                return;
+            }
+            // <ESC>W and the certificate follow
+            strcpy(certName, name);
+            certExpected = length + 2;
+            certReceived = 0;
+            certCorrupt = false;
+            reply("\r\nOK\r\n");
+        }
+        else if(strncmp(line, "AT+NCTCP=", 9) == 0)
+        {
+            reply("\r\nCONNECT 1\r\n\r\nOK\r\n");
+        }
+        else if(sscanf(line, "AT+SSLOPEN=%x,%15s", &id, name) == 2)
+        {
+            reply((id == 1 && strcmp(name, certName) == 0) ? "\r\nOK\r\n" : "\r\nERROR\r\n");
+        }
+        else if(strcmp(line, "AT+SSLCLOSE=1") == 0 || strcmp(line, "AT+NCLOSE=1") == 0)
+        {
+            reply("\r\nOK\r\n");
+        }
+    }
+
+    // runs on the host end's delivery thread
+    void received(uint8_t c)
+    {
+        if(bulkReceived < bulkExpected)
+        {
+            bulkCorrupt |= (c != static_cast<uint8_t>(bulkReceived % 251));
+            if(++bulkReceived == bulkExpected)
+            {
+                bulkExpected = 0;
+                reply(bulkCorrupt ? DATASENDFAIL : DATASENDOK);
+            }
+            return;
+        }
+
+        if(certReceived < certExpected)
+        {
+            // <ESC>W, then the certificate
+            char expected = (certReceived == 0) ? ESC
+                          : (certReceived == 1) ? 'W'
+                          : static_cast<char>(certReceived - 2);
+            certCorrupt |= (c != static_cast<uint8_t>(expected));
+            if(++certReceived == certExpected)
+            {
+                certExpected = 0;
+                reply(certCorrupt ? "\r\nERROR\r\n" : "\r\nOK\r\n");
+            }
+            return;
+        }
+
+        if(c == ESC)
+        {
+            strayData = true;
+        }
+        else if(c == '\n')
+        {
+            line[commandLen] = '\0';
+            commandLen = 0;
+            command();
+        }
+        else if(c != '\r' && commandLen + 1 < sizeof(line))
+        {
+            line[commandLen++] = c;
+        }
+    }
+
+    char line[48];
+    size_t commandLen;
+    unsigned bulkExpected;
+    unsigned bulkReceived;
+    bool bulkCorrupt;
+    unsigned certExpected;
+    unsigned certReceived;
+    bool certCorrupt;
+};
+
+static BufferedAT* parser;
+static GS1500M* driver;
+static FakeModule* driverModule;
+
+// frames seen by the BufferedAT under test
+static unsigned frameHeaders;
+static unsigned framesRejected;
+static unsigned framesEnded;
+static char framePayload[16];
+static size_t framePayloadLen;
+
+static int testFrameHeader(const char* header)
+{
+    // <CID><4 digits length>, as the module sends it
+    frameHeaders++;
+    int length = 0;
+    for(int i = 1; i < 5; i++)
+    {
+        if(header[i] < '0' || header[i] > '9')
+        {
+            framesRejected++;
+            return -1;
+        }
+        length = 10 * length + (header[i] - '0');
+    }
+    return length;
+}
+
+static void testFrameData(const char* data, size_t len)
+{
+    if(framePayloadLen + len <= sizeof(framePayload))
+    {
+        memcpy(framePayload + framePayloadLen, data, len);
+    }
+    framePayloadLen += len;
+}
+
+static void testFrameEnd()
+{
+    framesEnded++;
+}
+
+static void test_command_response()
+{
+    BufferedAT::Transaction transaction(*parser, 1000);
+    TEST_ASSERT_TRUE(parser->send("AT\n"));
+    TEST_ASSERT_TRUE(parser->recv("OK"));
+}
+
+static void test_failure_line()
+{
+    BufferedAT::Transaction transaction(*parser, 1000);
+    char line[32];
+    TEST_ASSERT_TRUE(parser->send("AT+FAIL\n"));
+    while(parser->readLine(line, sizeof(line)) >= 0)
+    {
+        // empty line before the result
+    }
+    TEST_ASSERT_EQUAL(0, parser->failure());
+    TEST_ASSERT_EQUAL_STRING("ERROR: INVALID INPUT", parser->failureLine());
+}
+
+static void test_failure_text_inside_line()
+{
+    BufferedAT::Transaction transaction(*parser, 1000);
+    TEST_ASSERT_TRUE(parser->send("AT+SCAN\n"));
+    TEST_ASSERT_TRUE(parser->recv("OK"));
+    TEST_ASSERT_EQUAL(-1, parser->failure());
+}
+
+static void test_write_larger_than_pipe()
+{
+    static char data[BULK_SIZE];
+    for(size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = i % 251;
+    }
+
+    BufferedAT::Transaction transaction(*parser, 2000);
+    TEST_ASSERT_TRUE(parser->send("AT+BULK=%u\n", BULK_SIZE));
+    TEST_ASSERT_TRUE(parser->recv("OK"));
+    TEST_ASSERT_EQUAL(sizeof(data), parser->write(data, sizeof(data)));
+    TEST_ASSERT_TRUE(parser->waitTxIdle());
+    TEST_ASSERT_EQUAL(0, parser->recvAny({DATASENDOK, DATASENDFAIL}));
+}
+
+static void test_fields_partial_lines()
+{
+    BufferedAT::Transaction transaction(*parser, 1000);
+    char ip[16];
+    char mac[18];
+    uint8_t macBytes[6];
+    int cid = -1;
+    TEST_ASSERT_TRUE(parser->send("AT+FIELDS\n"));
+    TEST_ASSERT_TRUE(parser->match("IP addr=", Ipv4Field(ip, sizeof(ip)),
+                                   "MAC=", MacField(mac, sizeof(mac), macBytes),
+                                   "CID=", HexField(cid),
+                                   "OK"));
+    TEST_ASSERT_EQUAL_STRING("192.168.1.5", ip);
+    TEST_ASSERT_EQUAL_STRING("00:1d:c9:a0:0B:ff", mac);
+    TEST_ASSERT_EQUAL(0xc9, macBytes[2]);
+    TEST_ASSERT_EQUAL(0x0b, macBytes[4]);
+    TEST_ASSERT_EQUAL(0xa, cid);
+}
+
+static void test_field_out_of_range()
+{
+    BufferedAT::Transaction transaction(*parser, 1000);
+    char ip[16];
+    TEST_ASSERT_TRUE(parser->send("AT+BADIP\n"));
+    TEST_ASSERT_FALSE(parser->match("IP addr=", Ipv4Field(ip, sizeof(ip))));
+    TEST_ASSERT_TRUE(parser->recv("OK"));
+}
+
+static void test_frame_resync()
+{
+    frameHeaders = 0;
+    framesRejected = 0;
+    framesEnded = 0;
+    framePayloadLen = 0;
+
+    BufferedAT::Transaction transaction(*parser, 1000);
+    TEST_ASSERT_TRUE(parser->send("AT+FRAMES\n"));
+    // frame ends before the OK behind it reaches the response buffer
+    TEST_ASSERT_TRUE(parser->recv("OK"));
+    TEST_ASSERT_EQUAL(2, frameHeaders);
+    TEST_ASSERT_EQUAL(1, framesRejected);
+    TEST_ASSERT_EQUAL(1, framesEnded);
+    TEST_ASSERT_EQUAL(6, framePayloadLen);
+    TEST_ASSERT_EQUAL(0, memcmp(framePayload, "ab\x1BZcd", 6));
+}
+
+static void test_rtt_backoff_and_floor()
+{
+    RttEstimator rtt;
+    // ceiling as is until the first sample
+    TEST_ASSERT_EQUAL(5000, rtt.timeout(5000));
+
+    // SRTT 100, RTTVAR 50: 100 + 4 * 50
+    rtt.sample(100);
+    TEST_ASSERT_EQUAL(300, rtt.timeout(5000));
+    rtt.timedOut();
+    TEST_ASSERT_EQUAL(600, rtt.timeout(5000));
+    rtt.timedOut();
+    TEST_ASSERT_EQUAL(1200, rtt.timeout(5000));
+    TEST_ASSERT_EQUAL(1000, rtt.timeout(1000));
+
+    // an answer ends the backoff, 4 * RTTVAR shrinks to 150
+    rtt.sample(100);
+    TEST_ASSERT_EQUAL(0, rtt.get().backoff);
+    TEST_ASSERT_EQUAL(250, rtt.timeout(5000));
+
+    rtt.setFloor(400);
+    TEST_ASSERT_EQUAL(400, rtt.timeout(5000));
+    // ceiling still wins over the floor
+    TEST_ASSERT_EQUAL(200, rtt.timeout(200));
+
+    for(int i = 0; i < 10; i++)
+    {
+        rtt.timedOut();
+    }
+    TEST_ASSERT_EQUAL(6, rtt.get().backoff);
+    TEST_ASSERT_EQUAL(12, rtt.get().timeouts);
+}
+
+static void test_results()
+{
+    static const struct
+    {
+        const char* answer;
+        GS1500MResult result;
+    } results[] = {
+        {"\r\nOK\r\n", GS1500M_RESULT_OK},
+        {"\r\n0\r\n", GS1500M_RESULT_OK},
+        {"\r\n2\r\n", GS1500M_RESULT_INVALID_INPUT},
+        {"\r\n6\r\n", GS1500M_RESULT_NOT_SUPPORTED},
+        {"\r\nERROR\r\n", GS1500M_RESULT_ERROR},
+        {"\r\nERROR: INVALID INPUT\r\n", GS1500M_RESULT_INVALID_INPUT},
+        {"\r\nERROR: IP CONFIG FAIL\r\n", GS1500M_RESULT_ERROR},
+        {"\r\nINVALID INPUT\r\n", GS1500M_RESULT_INVALID_INPUT},
+        // failure text inside a line is information text
+        {"\r\nCERT ERROR COUNT 0\r\nOK\r\n", GS1500M_RESULT_OK},
+        {"\r\n12\r\nOK\r\n", GS1500M_RESULT_OK},
+    };
+
+    for(size_t i = 0; i < sizeof(results) / sizeof(results[0]); i++)
+    {
+        driverModule->answer = results[i].answer;
+        TEST_ASSERT_EQUAL(results[i].result == GS1500M_RESULT_OK, driver->removeCertificate("ca", 1000));
+        TEST_ASSERT_EQUAL(results[i].result, driver->getLastResult());
+    }
+    driverModule->answer = "\r\nOK\r\n";
+}
+
+static void test_scan()
+{
+    WiFiAccessPoint aps[3];
+    TEST_ASSERT_EQUAL(3, driver->scan(aps, 3, 2000));
+    TEST_ASSERT_EQUAL_STRING("Home, Net", aps[0].get_ssid());
+    TEST_ASSERT_EQUAL(0x1d, aps[0].get_bssid()[1]);
+    TEST_ASSERT_EQUAL(0xff, aps[0].get_bssid()[5]);
+    TEST_ASSERT_EQUAL(6, aps[0].get_channel());
+    TEST_ASSERT_EQUAL(-52, aps[0].get_rssi());
+    TEST_ASSERT_EQUAL(NSAPI_SECURITY_WPA2, aps[0].get_security());
+    TEST_ASSERT_EQUAL_STRING("Guest", aps[1].get_ssid());
+    TEST_ASSERT_EQUAL(NSAPI_SECURITY_NONE, aps[1].get_security());
+    TEST_ASSERT_EQUAL(NSAPI_SECURITY_WEP, aps[2].get_security());
+
+    // the rest is skipped, the result still read
+    WiFiAccessPoint first;
+    TEST_ASSERT_EQUAL(1, driver->scan(&first, 1, 2000));
+    TEST_ASSERT_EQUAL_STRING("Home, Net", first.get_ssid());
+    TEST_ASSERT_EQUAL(GS1500M_RESULT_OK, driver->getLastResult());
+}
+
+static void test_tls_certificate_and_open()
+{
+    static char cert[CERT_SIZE];
+    for(size_t i = 0; i < sizeof(cert); i++)
+    {
+        cert[i] = static_cast<char>(i);
+    }
+
+    // refused by the command, nothing may follow it
+    driverModule->strayData = false;
+    TEST_ASSERT_FALSE(driver->addCertificate("bad", cert, sizeof(cert), 1000));
+    TEST_ASSERT_EQUAL(GS1500M_RESULT_INVALID_INPUT, driver->getLastResult());
+    TEST_ASSERT_FALSE(driverModule->strayData);
+
+    TEST_ASSERT_TRUE(driver->addCertificate("ca", cert, sizeof(cert), 2000));
+    TEST_ASSERT_EQUAL_STRING("ca", driverModule->certName);
+
+    int id = -1;
+    TEST_ASSERT_TRUE(driver->open("TCP", id, "192.168.1.5", 443, 1000));
+    TEST_ASSERT_EQUAL(1, id);
+    TEST_ASSERT_FALSE(driver->openTls(id, "other", 1000));
+    TEST_ASSERT_FALSE(driver->isTls(id));
+    TEST_ASSERT_TRUE(driver->openTls(id, "ca", 1000));
+    TEST_ASSERT_TRUE(driver->isTls(id));
+    TEST_ASSERT_TRUE(driver->close(id, 1000));
+    TEST_ASSERT_FALSE(driver->isTls(id));
+}
+
+utest::v1::status_t greentea_test_setup(const size_t number_of_cases)
+{
+    GREENTEA_SETUP(30, "default_auto");
+    return greentea_test_setup_handler(number_of_cases);
+}
+
+Case cases[] = {
+    Case("command and response", test_command_response),
+    Case("failure line", test_failure_line),
+    Case("failure text inside a line", test_failure_text_inside_line),
+    Case("write larger than the pipe", test_write_larger_than_pipe),
+    Case("fields split across lines", test_fields_partial_lines),
+    Case("field out of range", test_field_out_of_range),
+    Case("frame resync", test_frame_resync),
+    Case("RTT backoff and floor", test_rtt_backoff_and_floor),
+    Case("numeric and verbose results", test_results),
+    Case("scan", test_scan),
+    Case("TLS certificate and open", test_tls_certificate_and_open),
+};
+
+Specification specification(greentea_test_setup, cases, greentea_test_teardown_handler);
+
+int main()
+{
+    // BufferedAT on its own
+    PipeTransport hostEnd;
+    FakeModule module;
+    hostEnd.connect(module.end);
+    BufferedAT at(hostEnd);
+    at.registerFailure("ERROR");
+    const char bulk[] = {ESC, 'Z', '\0'};
+    at.registerFrame(bulk, 5, callback(testFrameHeader), callback(testFrameData), callback(testFrameEnd));
+    parser = &at;
+
+    // the whole driver
+    PipeTransport driverEnd;
+    FakeModule fake;
+    driverEnd.connect(fake.end);
+    GS1500M gs(driverEnd);
+    gs.setNumericResults(false);
+    driver = &gs;
+    driverModule = &fake;
+
+    return !Harness::run(specification);
+}